@@ -8,6 +8,7 @@
  */
 
 #include "Color.h"
+#include "Environment.h"
 #include "configuration.h"
 
 #include <iostream>
@@ -40,9 +41,9 @@ Color::Color(char c) {
     color = Color(1, 1, 1);
     break;
   case '?':
-    color = Color((static_cast<float>(rand())) / (static_cast<float>(RAND_MAX)),
-                  (static_cast<float>(rand())) / (static_cast<float>(RAND_MAX)),
-                  (static_cast<float>(rand())) / (static_cast<float>(RAND_MAX)));
+    color = Color(Environment::getEnv()->getRandom().nextFloat(),
+                  Environment::getEnv()->getRandom().nextFloat(),
+                  Environment::getEnv()->getRandom().nextFloat());
     break;
   default:
     color = Color(1, 0.5, 1);
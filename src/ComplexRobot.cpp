@@ -86,42 +86,49 @@ Robot(COMPLEX, radius, loc, color, lineColor, targetId, env),
 
 ComplexRobot::~ComplexRobot() {}
 
-float ComplexRobot::getLeftSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                                 float leftRobotSensorVal, float rightRobotSensorVal,
-                                 float leftObstacleSensorVal, float rightObstacleSensorVal,
-                                 float leftTargetSensorVal, float rightTargetSensorVal) {
-  return 
-    (enableLightSensors?
-     lightSensorsCrossed? rightLightSensorVal : leftLightSensorVal :
-     0) * GET_FLOAT("SPEED_SCALE_FACTOR") * lightSensorScale +
-    (enableRobotSensors?
-     robotSensorsCrossed? rightRobotSensorVal : leftRobotSensorVal :
-     0) * GET_FLOAT("SPEED_SCALE_FACTOR") * robotSensorScale +
-    (enableObstacleSensors?
-     obstacleSensorsCrossed? rightObstacleSensorVal : leftObstacleSensorVal :
-     0) * GET_FLOAT("SPEED_SCALE_FACTOR") * obstacleSensorScale +
-    (enableTargetSensors?
-     targetSensorsCrossed? rightTargetSensorVal : leftTargetSensorVal :
-     0) * GET_FLOAT("SPEED_SCALE_FACTOR") * targetSensorScale +
-    defaultSpeed;
+unsigned ComplexRobot::getSensorsUsed() const {
+  return
+    (enableLightSensors? sensorBit(LIGHT) : 0) |
+    (enableRobotSensors? sensorBit(ROBOT) : 0) |
+    (enableObstacleSensors? sensorBit(OBSTACLE) : 0) |
+    (enableTargetSensors? sensorBit(TARGET) : 0);
 }
 
-float ComplexRobot::getRightSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                                  float leftRobotSensorVal, float rightRobotSensorVal,
-                                  float leftObstacleSensorVal, float rightObstacleSensorVal,
-                                  float leftTargetSensorVal, float rightTargetSensorVal) {
-  return
-    (enableLightSensors?
-     lightSensorsCrossed? leftLightSensorVal : rightLightSensorVal :
-     0) * GET_FLOAT("SPEED_SCALE_FACTOR") * lightSensorScale +
-    (enableRobotSensors?
-     robotSensorsCrossed? leftRobotSensorVal : rightRobotSensorVal :
-     0) * GET_FLOAT("SPEED_SCALE_FACTOR") * robotSensorScale +
-    (enableObstacleSensors?
-     obstacleSensorsCrossed? leftObstacleSensorVal : rightObstacleSensorVal :
-     0) * GET_FLOAT("SPEED_SCALE_FACTOR") * obstacleSensorScale +
-    (enableTargetSensors?
-     targetSensorsCrossed? leftTargetSensorVal : rightTargetSensorVal :
-     0) * GET_FLOAT("SPEED_SCALE_FACTOR") * targetSensorScale +
-    defaultSpeed;
+WheelSpeeds ComplexRobot::getWheelSpeeds(const SensorReadings &readings) {
+  // Each enabled type adds its scaled left reading to one wheel and its scaled right
+  // reading to the other, depending on whether it is crossed
+  float scale = GET_FLOAT("SPEED_SCALE_FACTOR");
+  float left = 0, right = 0;
+  float light0 = 0, light1 = 0, robot0 = 0, robot1 = 0;
+  float obstacle0 = 0, obstacle1 = 0, target0 = 0, target1 = 0;
+  if (enableLightSensors) {
+    light0 = readings.get(LIGHT, 0) * scale * lightSensorScale;
+    light1 = readings.get(LIGHT, 1) * scale * lightSensorScale;
+  }
+  if (enableRobotSensors) {
+    robot0 = readings.get(ROBOT, 0) * scale * robotSensorScale;
+    robot1 = readings.get(ROBOT, 1) * scale * robotSensorScale;
+  }
+  if (enableObstacleSensors) {
+    obstacle0 = readings.get(OBSTACLE, 0) * scale * obstacleSensorScale;
+    obstacle1 = readings.get(OBSTACLE, 1) * scale * obstacleSensorScale;
+  }
+  if (enableTargetSensors) {
+    target0 = readings.get(TARGET, 0) * scale * targetSensorScale;
+    target1 = readings.get(TARGET, 1) * scale * targetSensorScale;
+  }
+
+  left  += lightSensorsCrossed?    light1    : light0;
+  right += lightSensorsCrossed?    light0    : light1;
+  left  += robotSensorsCrossed?    robot1    : robot0;
+  right += robotSensorsCrossed?    robot0    : robot1;
+  left  += obstacleSensorsCrossed? obstacle1 : obstacle0;
+  right += obstacleSensorsCrossed? obstacle0 : obstacle1;
+  left  += targetSensorsCrossed?   target1   : target0;
+  right += targetSensorsCrossed?   target0   : target1;
+
+  WheelSpeeds speeds;
+  speeds.left  = left + defaultSpeed;
+  speeds.right = right + defaultSpeed;
+  return speeds;
 }
@@ -7,7 +7,7 @@
 
 #include "PhysicalObject.h"
 #include "Robot.h"
-#include "Sensor.h"
+#include "SensorArray.h"
 #include "configuration.h"
 
 /** \brief A complex robot with configurable feedback from all sensors */
@@ -49,14 +49,8 @@ public:
 
   ~ComplexRobot();
 
-  float getLeftSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                     float leftRobotSensorVal, float rightRobotSensorVal,
-                     float leftObstacleSensorVal, float rightObstacleSensorVal,
-                     float leftTargetSensorVal, float rightTargetSensorVal);
-  float getRightSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                      float leftRobotSensorVal, float rightRobotSensorVal,
-                      float leftObstacleSensorVal, float rightObstacleSensorVal,
-                      float leftTargetSensorVal, float rightTargetSensorVal);
+  unsigned getSensorsUsed() const;
+  WheelSpeeds getWheelSpeeds(const SensorReadings &readings);
 
   const bool enableLightSensors, enableRobotSensors, enableObstacleSensors, enableTargetSensors;
   const bool lightSensorsCrossed, robotSensorsCrossed, obstacleSensorsCrossed, targetSensorsCrossed;
@@ -8,17 +8,21 @@
 
 #include "PhysicalObject.h"
 #include "Environment.h"
+#include "SpatialGrid.h"
 #include "configuration.h"
 
 #include <iostream>
 #include <math.h>
 using namespace std;
 
-Environment *Environment::currentEnv;
+thread_local Environment *Environment::currentEnv;
+atomic<unsigned> Environment::numEnvs(0);
 
 Environment::Environment(int width, int height) :
-  id(0), numObjects(0),
-  width(width), height(height) {
+  serial(numEnvs++), id(0), numObjects(0),
+  width(width), height(height),
+  time(0), revision(0), seed(0), numObjectStreams(0), packedRevision(-1),
+  gridValid(false), obstacleGrid(NULL) {
   objectsMutex = new mutex();
 }
 
@@ -27,6 +31,7 @@ Environment::~Environment() {
     delete o;
   }
   delete objectsMutex;
+  delete obstacleGrid;
 }
 
 Environment *Environment::newEnv(int width, int height) {
@@ -45,6 +50,17 @@ void Environment::setEnv(Environment *newEnv) {
   currentEnv = newEnv;
 }
 
+void Environment::seedRandom(uint64_t seed) {
+  this->seed = seed;
+  random = RandomStream(seed);
+  numObjectStreams = 0;
+}
+
+RandomStream Environment::newObjectStream() {
+  // Stream 0 is the environment's own
+  return RandomStream(seed, ++numObjectStreams);
+}
+
 int Environment::addObject(PhysicalObject *object) {
   objectsMutex->lock();
   if (id < (int)objects.size())
@@ -53,6 +69,8 @@ int Environment::addObject(PhysicalObject *object) {
     objects.push_back(object);
   id++;
   numObjects++;
+  revision++;
+  gridValid = false;
   objectsMutex->unlock();
   return id - 1;
 }
@@ -67,6 +85,8 @@ void Environment::removeObject(int id) {
     objects[id] = NULL;
     numObjects--;
   }
+  revision++;
+  gridValid = false;
   objectsMutex->unlock();
 }
 
@@ -75,6 +95,9 @@ void Environment::clear() {
     delete o;
   }
   id = 0;
+  time = 0;
+  revision++;
+  gridValid = false;
 }
 
 unsigned Environment::getNumObjects() const {
@@ -101,6 +124,55 @@ Environment::iterator Environment::end() const {
   return Environment::iterator(this, objects.size());
 }
 
+void Environment::step() {
+  time++;
+  revision++;
+  gridValid = false;
+}
+
+const Environment::PackedObjects &Environment::getPackedObjects(int type) {
+  if (packedRevision != revision)
+    packObjects();
+  return packedObjects[type];
+}
+
+void Environment::packObjects() {
+  // Keep the existing buffers around so their storage is reused between steps
+  for (auto &entry : packedObjects) {
+    entry.second.x.clear();
+    entry.second.y.clear();
+  }
+
+  for (PhysicalObject *o : *this) {
+    if (o != NULL) {
+      PackedObjects &packed = packedObjects[o->objectType];
+      float x = o->getXPosition();
+      float y = o->getYPosition();
+      for (int i = -1; i <= 1; i++) {
+        for (int j = -1; j <= 1; j++) {
+          packed.x.push_back(i * width + x);
+          packed.y.push_back(j * height + y);
+        }
+      }
+    }
+  }
+  packedRevision = revision;
+}
+
+const SpatialGrid &Environment::getObstacleGrid() {
+  if (obstacleGrid == NULL)
+    obstacleGrid = new SpatialGrid(width, height);
+  if (!gridValid) {
+    obstacleGrid->clear(width, height);
+    for (PhysicalObject *o : *this) {
+      if (o != NULL && o->objectType == OBSTACLE)
+        obstacleGrid->insert(o->getLocation(), o->getRadius());
+    }
+    gridValid = true;
+  }
+  return *obstacleGrid;
+}
+
 // Collision stuff
 
 /**
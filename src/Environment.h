@@ -9,14 +9,17 @@
  */
 
 #include "Location.h"
+#include "RandomStream.h"
 #include "configuration.h"
 
 #include <unordered_map>
+#include <atomic>
 #include <vector>
 #include <mutex>
 #include <stdexcept>
 
 class PhysicalObject;
+class SpatialGrid;
 
 /**
  * \brief environment namespace, handles all the objects as a group.  Also manages
@@ -26,6 +29,16 @@ class Environment {
 public:
   class iterator;
 
+  /**
+   * \brief The positions of all objects of one type, packed into contiguous arrays
+   * \details Every object appears 9 times, once for each wrapped copy of the
+   * environment, so sensors can treat the arrays as a flat list of points
+   */
+  struct PackedObjects {
+    std::vector<float> x;
+    std::vector<float> y;
+  };
+
   /**
    * \brief Environment constructor
    * \param width The width of the environment
@@ -52,18 +65,20 @@ public:
 
   /**
    * Gets the current environment referenced by all functions.  If uninitialized, it is
-   * created with the default values.  
+   * created with the default values.  Each thread has its own current environment, so
+   * separate worlds can be simulated on separate threads.  
    * \returns a pointer to the environment
    */
   static Environment *getEnv();
 
   /**
-   * Sets the current environment referenced by all functions.  The user is responsible for
-   * saving or deleting the old environment.  
+   * Sets the current environment referenced by all functions on the calling thread.  The
+   * user is responsible for saving or deleting the old environment.  
    * \param newEnv The new environment
    */
   static void setEnv(Environment *newEnv);
 
+
   /**
    * \brief Adds an object to the environment
    * \param object The object to add
@@ -79,7 +94,8 @@ public:
 
   /**
    * \brief Removes all objects from the environment
-   * and resets the id counter
+   * and resets the id counter and the step counter, so sensors that aren't read every
+   * step are read on the same steps no matter what ran in the environment before
    */
   void clear();
 
@@ -108,6 +124,27 @@ public:
    */
   Environment::iterator end() const;
 
+  /**
+   * \brief Gets the environment's random stream, used for anything random that doesn't
+   * belong to a single object, such as where new objects are placed
+   * \return The stream
+   */
+  RandomStream &getRandom() {return random;}
+
+  /**
+   * \brief Seeds the environment's random stream, and the streams of the objects created
+   * after this
+   * \param seed The seed
+   */
+  void seedRandom(uint64_t seed);
+
+  /**
+   * \brief Gets a random stream for a new object.  Each object created since the
+   * environment was seeded gets a different stream, in the order they are created.  
+   * \return The stream
+   */
+  RandomStream newObjectStream();
+
   /**
    * \brief Gets the width of the environment
    * \return The width
@@ -132,6 +169,54 @@ public:
    */
   void setHeight(int height) {this->height = height;}
 
+  /**
+   * \brief Gets the number of steps the simulation has advanced in this environment
+   * \return The current step
+   */
+  int getTime() const {return time;}
+
+  /**
+   * \brief Advances the step counter.  Called once at the start of every update of
+   * the objects.  
+   */
+  void step();
+
+  /**
+   * \brief Gets the serial number of the environment, which no other environment made by
+   * the process has, even one made at the same address after this one is deleted
+   * \return The serial number
+   */
+  unsigned getSerial() const {return serial;}
+
+  /**
+   * \brief Gets the revision of the objects, which changes whenever the simulation
+   * steps, an object is added or removed, or an object is changed.  State computed
+   * from the objects can be cached until the revision changes.  
+   * \return The current revision
+   */
+  int getRevision() const {return revision;}
+
+  /**
+   * \brief Advances the revision, to mark that an object has changed
+   */
+  void touch() {revision++;}
+
+  /**
+   * Gets the positions of all objects of a type as packed arrays.  The arrays are
+   * gathered again whenever the revision has changed, so they always hold where the
+   * objects are now, even after objects moved earlier in the same step.  
+   * \param type The type of the objects
+   * \return The packed positions
+   */
+  const PackedObjects &getPackedObjects(int type);
+
+  /**
+   * Gets a grid of all obstacles for tracing rays.  It is rebuilt at most once per
+   * step, or again after an object is added or removed.  
+   * \return The obstacle grid
+   */
+  const SpatialGrid &getObstacleGrid();
+
   /**
    * Checks if an object is in the designated window
    * \details It returns true whenever the following conditions are met:
@@ -387,6 +472,7 @@ public:
   };
 
 private:
+  unsigned serial;
   int id;
   int numObjects;
   std::vector<PhysicalObject*> objects;
@@ -395,7 +481,23 @@ private:
 
   int width, height;
 
-  static Environment *currentEnv;
+  int time;
+  int revision;
+  uint64_t seed;
+  RandomStream random;
+  uint64_t numObjectStreams;
+  int packedRevision; // The revision packedObjects were gathered at
+  std::unordered_map<int, PackedObjects> packedObjects;
+  bool gridValid;
+  SpatialGrid *obstacleGrid;
+
+  /**
+   * \brief Gathers the positions of all objects into packedObjects
+   */
+  void packObjects();
+
+  static thread_local Environment *currentEnv;
+  static std::atomic<unsigned> numEnvs; // The number of environments made so far
 };
 
 /**
@@ -0,0 +1,104 @@
+/**
+ * \author Lucas Kramer
+ * \file  EvaluationCache.cpp
+ * \brief Implementation of the cache of network performances
+ */
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "EvaluationCache.h"
+
+EvaluationCache::EvaluationCache(const string &filename) :
+  filename(filename), fd(-1), offset(0) {
+  if (filename != "") {
+    fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+      cerr << "Could not open evaluation cache file " << filename << endl;
+      exit(1);
+    }
+    readNew();
+  }
+}
+
+EvaluationCache::~EvaluationCache() {
+  if (fd != -1)
+    close(fd);
+}
+
+uint64_t EvaluationCache::hash(const void *data, size_t size, uint64_t hash) {
+  const unsigned char *bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+bool EvaluationCache::find(uint64_t key, int &performance) {
+  lock_guard<mutex> lock(cacheMutex);
+  numLookups++;
+  auto entry = entries.find(key);
+  if (entry == entries.end()) {
+    // Another process may have evaluated the network since
+    readNew();
+    entry = entries.find(key);
+  }
+  if (entry == entries.end())
+    return false;
+  numHits++;
+  performance = entry->second;
+  return true;
+}
+
+void EvaluationCache::insert(uint64_t key, int performance) {
+  lock_guard<mutex> lock(cacheMutex);
+  if (!entries.insert(make_pair(key, performance)).second)
+    return;
+  if (fd != -1) {
+    // Appends of a whole record are never interleaved with another process's
+    Record record = {key, performance, 0};
+    record.check = getCheck(record);
+    if (write(fd, &record, sizeof(record)) != sizeof(record))
+      cerr << "Failed to write evaluation cache file " << filename << endl;
+  }
+}
+
+unsigned EvaluationCache::getNumLookups() const {
+  return numLookups;
+}
+
+unsigned EvaluationCache::getNumHits() const {
+  return numHits;
+}
+
+void EvaluationCache::readNew() {
+  if (fd == -1)
+    return;
+  struct stat buf;
+  if (fstat(fd, &buf) != 0 || buf.st_size < offset + (off_t)sizeof(Record))
+    return;
+
+  // Only whole records are read, in case the last one is still being written
+  size_t size = (buf.st_size - offset) / sizeof(Record) * sizeof(Record);
+  vector<Record> records(size / sizeof(Record));
+  ssize_t numRead = pread(fd, records.data(), size, offset);
+  if (numRead != (ssize_t)size) {
+    cerr << "Could not read evaluation cache file " << filename << endl;
+    return;
+  }
+  offset += size;
+  for (const Record &record : records) {
+    if (record.check == getCheck(record))
+      entries.insert(make_pair(record.key, record.performance));
+  }
+}
+
+uint32_t EvaluationCache::getCheck(const Record &record) {
+  return (uint32_t)(record.key >> 32) ^ (uint32_t)record.key ^ record.performance ^ RECORD_CHECK;
+}
@@ -0,0 +1,105 @@
+#pragma once
+/**
+ * \author Lucas Kramer
+ * \file  EvaluationCache.h
+ * \brief A cache of the performances of evaluated networks
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+/**
+ * \brief A cache of network performances, keyed by a hash of everything that decides the
+ * performance
+ * \details Entries are kept in memory, and appended to a file that is read when the cache
+ * is opened, so they last between runs.  Every process using the same file appends to it,
+ * and a miss first reads whatever the others appended since, so they share their
+ * evaluations too.  The cache can be used from several threads at once.
+ */
+class EvaluationCache {
+public:
+  /**
+   * Opens the cache, reading the entries already in its file
+   * \param filename the file, or "" to only keep entries in memory
+   */
+  EvaluationCache(const std::string &filename);
+
+  /**
+   * The EvaluationCache destructor
+   */
+  ~EvaluationCache();
+
+  /**
+   * Hashes some data with 64-bit FNV-1a, continuing from an earlier hash so that several
+   * pieces of data can be hashed together
+   * \param data the data
+   * \param size the size of the data in bytes
+   * \param hash the hash of the data before, or the FNV offset basis to start a new hash
+   * \return the hash
+   */
+  static uint64_t hash(const void *data, size_t size, uint64_t hash = FNV_OFFSET);
+
+  /**
+   * Looks up a performance
+   * \param key the hash of the network and scenario
+   * \param performance set to the performance if it is found
+   * \return true if the performance was found
+   */
+  bool find(uint64_t key, int &performance);
+
+  /**
+   * Adds a performance.  Only complete evaluations should be added.
+   * \param key the hash of the network and scenario
+   * \param performance the performance
+   */
+  void insert(uint64_t key, int performance);
+
+  /**
+   * Gets the number of lookups so far
+   * \return the number of lookups
+   */
+  unsigned getNumLookups() const;
+
+  /**
+   * Gets the number of lookups that found a performance so far
+   * \return the number of hits
+   */
+  unsigned getNumHits() const;
+
+  static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+
+private:
+  /** \brief An entry in the cache file */
+  struct Record {
+    uint64_t key;
+    int32_t performance;
+    uint32_t check;     // Derived from the rest, to skip anything that isn't a record
+  };
+
+  static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+  static const uint32_t RECORD_CHECK = 0x52524543;
+
+  std::string filename;
+  int fd;                 // The cache file, or -1
+  off_t offset;           // How much of the file has been read
+  std::mutex cacheMutex;  // Held while using the entries and the file
+  std::unordered_map<uint64_t, int> entries;
+  std::atomic<unsigned> numLookups{0};
+  std::atomic<unsigned> numHits{0};
+
+  /**
+   * Reads the records appended to the file since it was last read
+   */
+  void readNew();
+
+  /**
+   * Gets the check of a record
+   * \param record the record
+   * \return the value its check should have
+   */
+  static uint32_t getCheck(const Record &record);
+};
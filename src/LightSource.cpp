@@ -39,7 +39,7 @@ bool LightSource::handleCollision(int otherId, bool wasHit) {
     if (otherId == -1 ||
         env->getObject(otherId) == NULL || 
         env->getObject(otherId)->getSpeed() == 0)
-      setOrientation(rand() % 360);
+      setOrientation(random.nextInt(360));
   }
   else if (getSpeed() != 0) {
     reorient(GET_BOOL("OPPOSITE_ANGLES") && wasHit?
@@ -1,17 +1,23 @@
 /**
  * \author Lucas Kramer
  * \file  NeuralNetwork.cpp
- * \brief A feed-forward neural network class
+ * \brief A neural network class, with optional recurrent connections
  */
 
 #include <stdlib.h>
-#include <cassert>
+#include <limits.h>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <mutex>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <string.h>
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
@@ -21,191 +27,509 @@ using namespace boost;
 
 #include "NeuralNetwork.h"
 
-NeuralNetwork::Node::Node(int id, bool isInput, bool isOutput, float baseline,
-                          const vector<Node*> &inputs,
-                          const vector<float> &weights) : 
-  id(id),
-  isInput(isInput),
-  isOutput(isOutput),
-  baseline(baseline),
-  inputs(inputs),
-  weights(weights),
-  numReferences(0) {
-  for (Node *n : inputs) {
-    n->attatch();
-  }
+// The networks loaded by NeuralNetwork::get, by filename
+struct RegistryEntry {
+  struct timespec mtime;
+  off_t size;
+  NeuralNetwork *network;
+};
+static unordered_map<string, RegistryEntry> registry;
+static mutex registryMutex;
+
+// The most genomes kept for reuse once no network uses them
+static const unsigned MAX_FREE_GENOMES = 256;
+
+const char NeuralNetwork::BINARY_MAGIC[4] = {'R', 'R', 'N', 'N'};
+
+bool NeuralNetwork::Structure::operator==(const Structure &other) const {
+  return
+    numNodes == other.numNodes &&
+    inputs == other.inputs &&
+    outputs == other.outputs &&
+    isInput == other.isInput &&
+    isOutput == other.isOutput &&
+    activation == other.activation &&
+    innovation == other.innovation &&
+    start == other.start &&
+    source == other.source &&
+    feedbackStart == other.feedbackStart &&
+    feedbackSource == other.feedbackSource;
 }
 
-NeuralNetwork::Node::~Node() {
-  for (Node *n : inputs) {
-    n->detatch();
+NeuralNetwork::NeuralNetwork(const std::shared_ptr<const Structure> &structure,
+                             const std::shared_ptr<Genome> &genome) :
+  structure(structure),
+  genome(genome) {}
+
+NeuralNetwork::NeuralNetwork(const string &filename) :
+  NeuralNetwork(get(filename)) {}
+
+NeuralNetwork::NeuralNetwork(const NeuralNetwork &other) :
+  structure(other.structure),
+  genome(other.genome) {}
+
+NeuralNetwork::~NeuralNetwork() {}
+
+std::shared_ptr<const NeuralNetwork::Structure> NeuralNetwork::share(Structure &structure) {
+  // The structures of every network, so networks with the same structure share one
+  static vector<std::weak_ptr<const Structure> > structures;
+  static mutex structuresMutex;
+
+  lock_guard<mutex> lock(structuresMutex);
+  for (unsigned i = 0; i < structures.size(); i++) {
+    std::shared_ptr<const Structure> existing = structures[i].lock();
+    if (existing == NULL) {
+      structures.erase(structures.begin() + i--);
+      continue;
+    }
+    if (*existing == structure)
+      return existing;
+  }
+
+  // Use a specialized evaluator if the network has the same structure as one of them.  
+  // The evaluator reads the baselines from after the input nodes, and the weights, so
+  // the input nodes must come first and have no connections.  
+  structure.topology = NULL;
+  for (const networkkernel::Topology &t : networkkernel::getTopologies()) {
+    bool matches =
+      t.numNodes == structure.numNodes &&
+      t.numInputs == structure.inputs.size() &&
+      t.numOutputs == structure.outputs.size() &&
+      structure.start[t.numInputs] == 0 &&
+      structure.feedbackSource.empty() &&
+      count(structure.activation.begin(), structure.activation.end(),
+            networkkernel::LINEAR) == (int)structure.numNodes;
+    for (unsigned i = 0; matches && i < t.numInputs; i++)
+      matches = structure.inputs[i] == (int)i;
+    for (unsigned i = 0; matches && i < t.numOutputs; i++)
+      matches = structure.outputs[i] == t.outputs[i];
+    for (unsigned i = t.numInputs; matches && i <= t.numNodes; i++)
+      matches = !(i < t.numNodes && structure.isInput[i]) &&
+        structure.start[i] == t.start[i - t.numInputs];
+    for (unsigned i = 0; matches && i < t.numConnections; i++)
+      matches = structure.source[i] == t.source[i];
+    if (matches) {
+      structure.topology = &t;
+      break;
+    }
   }
+
+  std::shared_ptr<const Structure> result = std::make_shared<Structure>(move(structure));
+  structures.push_back(result);
+  return result;
+}
+
+void NeuralNetwork::assignStateSlots(Structure &structure) {
+  structure.stateNodes = structure.feedbackSource;
+  sort(structure.stateNodes.begin(), structure.stateNodes.end());
+  structure.stateNodes.erase(unique(structure.stateNodes.begin(), structure.stateNodes.end()),
+                             structure.stateNodes.end());
+  structure.feedbackSlot.clear();
+  for (int node : structure.feedbackSource)
+    structure.feedbackSlot.push_back(lower_bound(structure.stateNodes.begin(),
+                                                 structure.stateNodes.end(), node) -
+                                     structure.stateNodes.begin());
 }
 
-void NeuralNetwork::Node::attatch() {
-  numReferences++;
+int NeuralNetwork::splitInnovation(int source, int target) {
+  // Mix the two numbers so that splits of different connections rarely get the same one
+  uint64_t x = (uint64_t)(uint32_t)source << 32 | (uint32_t)target;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return FIRST_SPLIT_INNOVATION + x % (INT_MAX - FIRST_SPLIT_INNOVATION);
 }
 
-void NeuralNetwork::Node::detatch() {
-  numReferences--;
-  assert(numReferences >= 0);
-  if (numReferences == 0) {
-    delete this;
+std::shared_ptr<NeuralNetwork::Genome> NeuralNetwork::newGenome() {
+  // Genomes are returned to this when they are no longer used, which may be during exit,
+  // so it is never destroyed
+  static vector<Genome*> &freeGenomes = *new vector<Genome*>;
+  static mutex &freeGenomesMutex = *new mutex;
+
+  Genome *genome = NULL;
+  {
+    lock_guard<mutex> lock(freeGenomesMutex);
+    if (!freeGenomes.empty()) {
+      genome = freeGenomes.back();
+      freeGenomes.pop_back();
+    }
   }
+  if (genome == NULL)
+    genome = new Genome;
+  genome->clear();
+
+  return std::shared_ptr<Genome>(genome, [](Genome *genome) {
+      lock_guard<mutex> lock(freeGenomesMutex);
+      if (freeGenomes.size() < MAX_FREE_GENOMES)
+        freeGenomes.push_back(genome);
+      else
+        delete genome;
+    });
+}
+
+vector<float> NeuralNetwork::compute(const vector<float> &inputs) const {
+  if (inputs.size() != structure->inputs.size())
+    throw new runtime_error("Incorrect number of inputs to neural network");
+
+  vector<float> outputs(structure->outputs.size());
+  vector<float> scratch(getScratchSize());
+  vector<float> state(getStateSize());
+  compute(inputs.data(), outputs.data(), scratch.data(), state.data());
+  return outputs;
 }
 
-NeuralNetwork::NeuralNetwork(const vector<int> &inputs,
-                             const vector<int> &outputs,
-                             const vector<Node*> &nodes) :
-  inputs(inputs),
-  outputs(outputs),
-  nodes(nodes),
-  nodeValue(nodes.size()),
-  nodeComputed(nodes.size()),
-  inputIndex(inputs.size()) {
-  for (unsigned i = 0; i < inputs.size(); i++) {
-    inputIndex[nodes[inputs[i]]->id] = i;
+void NeuralNetwork::compute(const float *inputs, float *outputs, float *scratch,
+                            float *state) const {
+  const Structure &net = *structure;
+  const float *baseline = genome->data();
+  const float *weight = baseline + net.numNodes;
+  const float *feedbackWeight = weight + net.source.size();
+  if (net.topology != NULL) {
+    net.topology->evaluate(baseline + net.inputs.size(), inputs, outputs);
+    return;
   }
-  for (Node *n : nodes) {
-    n->attatch();
+
+  float *value = scratch;
+  for (unsigned i = 0; i < net.inputs.size(); i++)
+    value[net.inputs[i]] = inputs[i];
+
+  for (unsigned i = 0; i < net.numNodes; i++) {
+    if (net.isInput[i])
+      continue;
+    float sum = baseline[i];
+    for (unsigned j = net.start[i]; j < net.start[i + 1]; j++)
+      sum += value[net.source[j]] * weight[j];
+    for (unsigned j = net.feedbackStart[i]; j < net.feedbackStart[i + 1]; j++)
+      sum += state[net.feedbackSlot[j]] * feedbackWeight[j];
+    switch (net.activation[i]) {
+    case networkkernel::TANH:
+      sum = networkkernel::tanhApprox(sum);
+      break;
+    case networkkernel::SIGMOID:
+      sum = networkkernel::sigmoidApprox(sum);
+      break;
+    }
+    value[i] = sum;
   }
+
+  // The state is only replaced once every node has read it
+  for (unsigned i = 0; i < net.stateNodes.size(); i++)
+    state[i] = value[net.stateNodes[i]];
+
+  for (unsigned i = 0; i < net.outputs.size(); i++)
+    outputs[i] = value[net.outputs[i]];
 }
 
-NeuralNetwork::NeuralNetwork(const string &filename) {
-  NeuralNetwork loadRes = load(filename);
-  inputs = loadRes.inputs;
-  outputs = loadRes.outputs;
-  nodes = loadRes.nodes;
-  nodeValue = loadRes.nodeValue;
-  nodeComputed = loadRes.nodeComputed;
-  inputIndex = loadRes.inputIndex;
-  for (unsigned i = 0; i < inputs.size(); i++) {
-    inputIndex[nodes[inputs[i]]->id] = i;
+void NeuralNetwork::compute(const float *inputs, float *outputs, unsigned count,
+                            float *scratch, float *state) const {
+  const Structure &net = *structure;
+  const float *baseline = genome->data();
+  const float *weight = baseline + net.numNodes;
+  const float *feedbackWeight = weight + net.source.size();
+  unsigned numInputs = net.inputs.size();
+  unsigned numOutputs = net.outputs.size();
+  unsigned stateSize = net.stateNodes.size();
+  // Values are stored by node, with the values for the whole batch together
+  float *value = scratch;
+  for (unsigned i = 0; i < numInputs; i++) {
+    float *row = value + net.inputs[i] * count;
+    for (unsigned n = 0; n < count; n++)
+      row[n] = inputs[n * numInputs + i];
   }
-  for (Node *n : nodes) {
-    n->attatch();
+
+  for (unsigned i = 0; i < net.numNodes; i++) {
+    if (net.isInput[i])
+      continue;
+    float *row = value + i * count;
+    for (unsigned n = 0; n < count; n++)
+      row[n] = baseline[i];
+    for (unsigned j = net.start[i]; j < net.start[i + 1]; j++) {
+      const float *source = value + net.source[j] * count;
+      float w = weight[j];
+      for (unsigned n = 0; n < count; n++)
+        row[n] += source[n] * w;
+    }
+    for (unsigned j = net.feedbackStart[i]; j < net.feedbackStart[i + 1]; j++) {
+      const float *source = state + net.feedbackSlot[j];
+      float w = feedbackWeight[j];
+      for (unsigned n = 0; n < count; n++)
+        row[n] += source[n * stateSize] * w;
+    }
+    networkkernel::activate((networkkernel::Activation)net.activation[i], row, count);
   }
-}
 
-NeuralNetwork::NeuralNetwork(const NeuralNetwork &other) :
-  NeuralNetwork(other.inputs, other.outputs, other.nodes) {}
+  for (unsigned i = 0; i < stateSize; i++) {
+    const float *row = value + net.stateNodes[i] * count;
+    for (unsigned n = 0; n < count; n++)
+      state[n * stateSize + i] = row[n];
+  }
 
-NeuralNetwork::~NeuralNetwork() {
-  for (Node *n : nodes) {
-    n->detatch();
+  for (unsigned i = 0; i < numOutputs; i++) {
+    const float *row = value + net.outputs[i] * count;
+    for (unsigned n = 0; n < count; n++)
+      outputs[n * numOutputs + i] = row[n];
   }
 }
 
-vector<float> NeuralNetwork::compute(const vector<float> &inputs) {
-  if (inputs.size() != this->inputs.size())
-    throw new runtime_error("Incorrect number of inputs to neural network");
+unsigned NeuralNetwork::getScratchSize() const {
+  return structure->numNodes;
+}
 
-  computeMutex.lock();
-  fill(nodeComputed.begin(), nodeComputed.end(), 0);
-  vector<float> outputs(this->outputs.size());
+unsigned NeuralNetwork::getStateSize() const {
+  return structure->stateNodes.size();
+}
 
-  for (unsigned i = 0; i < outputs.size(); i++) {
-    outputs[i] = computeNode(inputs, *nodes[this->outputs[i]]);
-  }
-  computeMutex.unlock();
-  return outputs;
+const char *NeuralNetwork::getEvaluatorName() const {
+  return structure->topology != NULL? structure->topology->name : "generic";
 }
 
-float NeuralNetwork::computeNode(const vector<float> &inputs, const Node &node) {
-  int id = node.id;
-  if (!nodeComputed[id]) {
-    if (node.isInput)
-      nodeValue[id] = inputs[inputIndex[id]];
-    else {
-      nodeValue[id] = node.baseline;
-      for (unsigned i = 0; i < node.inputs.size(); i++)
-        nodeValue[id] += computeNode(inputs, *node.inputs[i]) * node.weights[i];
-    }
-    nodeComputed[id] = true;
-  }
-  //  cout << "(" << id << ", " << nodeValue[id] << ")" << endl;
-  return nodeValue[id];
+NeuralNetwork NeuralNetwork::withActivation(networkkernel::Activation activation) const {
+  Structure changed = *structure;
+  for (unsigned i = 0; i < changed.numNodes; i++)
+    changed.activation[i] = changed.isInput[i]? networkkernel::LINEAR : activation;
+  return NeuralNetwork(share(changed), genome);
 }
 
-NeuralNetwork NeuralNetwork::mutate(int numChanged, float amount) {
-  vector<Node*> newNodes;
-  for (unsigned i = 0; i < nodes.size(); i++) {
-    vector<Node*> newInputs;
-    for (Node *node : nodes[i]->inputs) {
-      newInputs.push_back(newNodes[node->id]);
-    }
-    newNodes.push_back(new Node(nodes[i]->id,
-                                nodes[i]->isInput,
-                                nodes[i]->isOutput,
-                                nodes[i]->baseline,
-                                newInputs,
-                                nodes[i]->weights));
+bool NeuralNetwork::sharesWeights(const NeuralNetwork &other) const {
+  return structure == other.structure && genome == other.genome;
+}
+
+unsigned NeuralNetwork::getNumInputs() const {
+  return structure->inputs.size();
+}
+
+unsigned NeuralNetwork::getNumOutputs() const {
+  return structure->outputs.size();
+}
+
+NeuralNetwork NeuralNetwork::mutate(int numChanged, float amount, RandomStream &random) const {
+  NeuralNetwork result(structure, newGenome());
+  *result.genome = *genome;
+  result.mutateInPlace(numChanged, amount, random);
+  return result;
+}
+
+NeuralNetwork::Genome &NeuralNetwork::getUnsharedGenome() {
+  if (genome.use_count() > 1) {
+    std::shared_ptr<Genome> copy = newGenome();
+    *copy = *genome;
+    genome = copy;
   }
+  return *genome;
+}
+
+void NeuralNetwork::mutateInPlace(int numChanged, float amount, RandomStream &random) {
+  // A node's feedback connections come after its other connections
+  const Structure &net = *structure;
+  float *weight = getUnsharedGenome().data() + net.numNodes;
+  float *feedbackWeight = weight + net.source.size();
   for (int i = 0; i < numChanged; i++) {
-    Node *changeNode = newNodes[rand() % newNodes.size()];
-    if (changeNode->weights.size() == 0) {
+    int changeNode = random.nextInt(net.numNodes);
+    unsigned numForward = net.start[changeNode + 1] - net.start[changeNode];
+    unsigned numWeights = numForward +
+      net.feedbackStart[changeNode + 1] - net.feedbackStart[changeNode];
+    if (numWeights == 0) {
       i--; // Add an extra cycle if there aren't any connections to change
       break;
     }
-    changeNode->weights[rand() % changeNode->weights.size()] +=
-      ((float)rand()) / ((float)RAND_MAX) * amount * 2 - amount;
+    // The amount is drawn before the connection, as it always has been
+    float delta = random.nextFloat() * amount * 2 - amount;
+    unsigned changeWeight = random.nextInt(numWeights);
+    if (changeWeight < numForward)
+      weight[net.start[changeNode] + changeWeight] += delta;
+    else
+      feedbackWeight[net.feedbackStart[changeNode] + changeWeight - numForward] += delta;
   }
-  return NeuralNetwork(inputs, outputs, newNodes);
 }
 
-NeuralNetwork NeuralNetwork::combine(const NeuralNetwork &other) {
-  if (nodes.size() != other.nodes.size()) {
-    throw new runtime_error("Combined networks must have the same structure");
+bool NeuralNetwork::addNode(RandomStream &random) {
+  const Structure &net = *structure;
+  if (net.source.empty())
+    return false;
+  unsigned split = random.nextInt(net.source.size());
+  unsigned target = upper_bound(net.start.begin(), net.start.end(), split) - net.start.begin() - 1;
+  int source = net.source[split];
+  int innovation = splitInnovation(net.innovation[source], net.innovation[target]);
+  if (find(net.innovation.begin(), net.innovation.end(), innovation) != net.innovation.end())
+    return false;
+
+  // The new node goes just before the target, so nodes stay in topological order and the
+  // ids of the target and every node after it go up by one.  State slots stay in the
+  // same order, so they don't need to be assigned again.  
+  Structure patched = net;
+  unsigned position = net.start[target];
+  auto renumber = [target](int &id) {
+    if (id >= (int)target)
+      id++;
+  };
+  for_each(patched.inputs.begin(), patched.inputs.end(), renumber);
+  for_each(patched.outputs.begin(), patched.outputs.end(), renumber);
+  for_each(patched.source.begin(), patched.source.end(), renumber);
+  for_each(patched.feedbackSource.begin(), patched.feedbackSource.end(), renumber);
+  for_each(patched.stateNodes.begin(), patched.stateNodes.end(), renumber);
+  patched.numNodes++;
+  patched.isInput.insert(patched.isInput.begin() + target, false);
+  patched.isOutput.insert(patched.isOutput.begin() + target, false);
+  patched.activation.insert(patched.activation.begin() + target, networkkernel::LINEAR);
+  patched.innovation.insert(patched.innovation.begin() + target, innovation);
+  patched.source[split] = target;
+  patched.source.insert(patched.source.begin() + position, source);
+  patched.start.insert(patched.start.begin() + target, position);
+  for (unsigned i = target + 1; i <= patched.numNodes; i++)
+    patched.start[i]++;
+  patched.feedbackStart.insert(patched.feedbackStart.begin() + target,
+                               net.feedbackStart[target]);
+
+  Genome &patchedGenome = getUnsharedGenome();
+  patchedGenome.insert(patchedGenome.begin() + target, 0);
+  patchedGenome.insert(patchedGenome.begin() + patched.numNodes + position, 1);
+  structure = share(patched);
+  return true;
+}
+
+bool NeuralNetwork::addConnection(float amount, RandomStream &random) {
+  // Give up after trying as many random pairs as there are nodes
+  const Structure &net = *structure;
+  for (unsigned i = 0; i < net.numNodes; i++) {
+    unsigned target = random.nextInt(net.numNodes);
+    if (target == 0 || net.isInput[target])
+      continue;
+    int source = random.nextInt(target);
+    if (find(net.source.begin() + net.start[target], net.source.begin() + net.start[target + 1],
+             source) != net.source.begin() + net.start[target + 1])
+      continue;
+
+    // The new connection comes after the target's other connections
+    float weight = random.nextFloat() * amount * 2 - amount;
+    unsigned position = net.start[target + 1];
+    Structure patched = net;
+    patched.source.insert(patched.source.begin() + position, source);
+    for (unsigned j = target + 1; j <= patched.numNodes; j++)
+      patched.start[j]++;
+
+    Genome &patchedGenome = getUnsharedGenome();
+    patchedGenome.insert(patchedGenome.begin() + net.numNodes + position, weight);
+    structure = share(patched);
+    return true;
   }
-  vector<Node*> newNodes;
-  for (unsigned i = 0; i < nodes.size(); i++) {
-    vector<Node*> newInputs;
-    for (Node *node : nodes[i]->inputs) {
-      if (i < nodes.size() / 2)
-        newInputs.push_back(newNodes[node->id]);
-      else
-        newInputs.push_back(newNodes[node->id]);
+  return false;
+}
+
+NeuralNetwork NeuralNetwork::combine(const NeuralNetwork &other) const {
+  const Structure &net = *structure, &otherNet = *other.structure;
+  if (net.inputs.size() != otherNet.inputs.size() ||
+      net.outputs.size() != otherNet.outputs.size()) {
+    throw new runtime_error("Combined networks must have the same inputs and outputs");
+  }
+  if (structure != other.structure && !(net == otherNet))
+    return combineAligned(other);
+
+  // The first half of the nodes come from this network, and the rest from the other
+  unsigned half = net.numNodes / 2;
+  const Genome &first = *genome, &second = *other.genome;
+  NeuralNetwork result(structure, newGenome());
+  Genome &combined = *result.genome;
+  combined.insert(combined.end(), first.begin(), first.begin() + half);
+  combined.insert(combined.end(), second.begin() + half, second.begin() + net.numNodes);
+  combined.insert(combined.end(),
+                  first.begin() + net.numNodes,
+                  first.begin() + net.numNodes + net.start[half]);
+  combined.insert(combined.end(),
+                  second.begin() + net.numNodes + net.start[half],
+                  second.begin() + net.numNodes + net.source.size());
+  unsigned feedback = net.numNodes + net.source.size();
+  combined.insert(combined.end(),
+                  first.begin() + feedback,
+                  first.begin() + feedback + net.feedbackStart[half]);
+  combined.insert(combined.end(),
+                  second.begin() + feedback + net.feedbackStart[half],
+                  second.end());
+  return result;
+}
+
+NeuralNetwork NeuralNetwork::combineAligned(const NeuralNetwork &other) const {
+  const Structure &net = *structure, &otherNet = *other.structure;
+  unordered_map<int, unsigned> otherNodes;
+  for (unsigned i = 0; i < otherNet.numNodes; i++)
+    otherNodes[otherNet.innovation[i]] = i;
+
+  // Start from this network's weights, and take the other network's for the nodes in the
+  // second half that it also has, and their connections that it also has
+  NeuralNetwork result(structure, newGenome());
+  Genome &combined = *result.genome;
+  combined = *genome;
+  float *weight = combined.data() + net.numNodes;
+  float *feedbackWeight = weight + net.source.size();
+  const float *otherBaseline = other.genome->data();
+  const float *otherWeight = otherBaseline + otherNet.numNodes;
+  const float *otherFeedbackWeight = otherWeight + otherNet.source.size();
+  for (unsigned i = net.numNodes / 2; i < net.numNodes; i++) {
+    auto match = otherNodes.find(net.innovation[i]);
+    if (match == otherNodes.end())
+      continue;
+    unsigned k = match->second;
+    combined[i] = otherBaseline[k];
+    for (unsigned j = net.start[i]; j < net.start[i + 1]; j++) {
+      for (unsigned l = otherNet.start[k]; l < otherNet.start[k + 1]; l++) {
+        if (otherNet.innovation[otherNet.source[l]] == net.innovation[net.source[j]]) {
+          weight[j] = otherWeight[l];
+          break;
+        }
+      }
+    }
+    for (unsigned j = net.feedbackStart[i]; j < net.feedbackStart[i + 1]; j++) {
+      for (unsigned l = otherNet.feedbackStart[k]; l < otherNet.feedbackStart[k + 1]; l++) {
+        if (otherNet.innovation[otherNet.feedbackSource[l]] ==
+            net.innovation[net.feedbackSource[j]]) {
+          feedbackWeight[j] = otherFeedbackWeight[l];
+          break;
+        }
+      }
     }
-    if (i < nodes.size() / 2)
-      newNodes.push_back(new Node(nodes[i]->id,
-                                  nodes[i]->isInput,
-                                  nodes[i]->isOutput,
-                                  nodes[i]->baseline,
-                                  newInputs,
-                                  nodes[i]->weights));
-    else
-      newNodes.push_back(new Node(nodes[i]->id,
-                                  nodes[i]->isInput,
-                                  nodes[i]->isOutput,
-                                  other.nodes[i]->baseline,
-                                  newInputs,
-                                  other.nodes[i]->weights));
   }
-  return NeuralNetwork(inputs, outputs, newNodes);
+  return result;
 }
 
-void NeuralNetwork::write(const string &filename) {
+void NeuralNetwork::write(const string &filename) const {
+  const Structure &net = *structure;
+  const float *baseline = genome->data();
+  const float *weight = baseline + net.numNodes;
+  const float *feedbackWeight = weight + net.source.size();
   ofstream output(filename);
   if (output.is_open()) {
-    for (Node *node : nodes) {
-      if (node->isInput)
+    for (unsigned i = 0; i < net.numNodes; i++) {
+      if (net.isInput[i])
         output << " input";
-      else if (node->isOutput)
+      else if (net.isOutput[i])
         output << "output";
       else
         output << "      ";
-      output << " node " << node->id;
-      if (node->baseline != 0)
-        output << " default " << node->baseline;
-      if (node->inputs.size() != 0) {
+      output << " node " << i;
+      if (net.innovation[i] != (int)i)
+        output << " innovation " << net.innovation[i];
+      if (baseline[i] != 0)
+        output << " default " << baseline[i];
+      if (net.activation[i] != networkkernel::LINEAR)
+        output << " activation " <<
+          networkkernel::getActivationName((networkkernel::Activation)net.activation[i]);
+      if (net.start[i + 1] != net.start[i]) {
         output << " connected to";
-        for (unsigned i = 0; i < node->inputs.size(); i++) {
-          output << " " << node->inputs[i]->id << ": " << node->weights[i];
+        for (unsigned j = net.start[i]; j < net.start[i + 1]; j++) {
+          output << " " << net.source[j] << ": " << weight[j];
+        }
+      }
+      if (net.feedbackStart[i + 1] != net.feedbackStart[i]) {
+        output << " feedback from";
+        for (unsigned j = net.feedbackStart[i]; j < net.feedbackStart[i + 1]; j++) {
+          output << " " << net.feedbackSource[j] << ": " << feedbackWeight[j];
         }
       }
       output << endl;
     }
     output.close();
+    forget(filename);
   }
   else {
     cerr << "Failed to write neural network description file " << filename << endl;
@@ -213,12 +537,94 @@ void NeuralNetwork::write(const string &filename) {
   }
 }
 
+void NeuralNetwork::writeBinary(const string &filename) const {
+  string data = toBinary();
+  ofstream output(filename, ios::binary);
+  if (output.is_open()) {
+    output.write(data.data(), data.size());
+    output.close();
+    forget(filename);
+  }
+  else {
+    cerr << "Failed to write neural network file " << filename << endl;
+    exit(1);
+  }
+}
+
+string NeuralNetwork::toBinary() const {
+  const Structure &net = *structure;
+  BinaryHeader header;
+  memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+  bool linear =
+    count(net.activation.begin(), net.activation.end(),
+          networkkernel::LINEAR) == (int)net.numNodes;
+  bool numbered = true;
+  for (unsigned i = 0; i < net.numNodes; i++)
+    numbered &= net.innovation[i] == (int)i;
+  header.version = !numbered? 4 : !linear? 3 : !net.feedbackSource.empty()? 2 : 1;
+  header.numNodes = net.numNodes;
+  header.numConnections = net.source.size();
+
+  vector<BinaryNode> binaryNodes;
+  for (unsigned i = 0; i < net.numNodes; i++) {
+    BinaryNode binaryNode;
+    binaryNode.flags =
+      (net.isInput[i]? BINARY_INPUT : 0) | (net.isOutput[i]? BINARY_OUTPUT : 0) |
+      net.activation[i] << BINARY_ACTIVATION_SHIFT;
+    binaryNode.baseline = (*genome)[i];
+    binaryNode.firstConnection = net.start[i];
+    binaryNode.numConnections = net.start[i + 1] - net.start[i];
+    binaryNodes.push_back(binaryNode);
+  }
+  vector<uint32_t> sources(net.source.begin(), net.source.end());
+  uint32_t numFeedback = net.feedbackSource.size();
+  vector<uint32_t> feedbackCounts;
+  for (unsigned i = 0; i < net.numNodes; i++)
+    feedbackCounts.push_back(net.feedbackStart[i + 1] - net.feedbackStart[i]);
+  vector<uint32_t> feedbackSources(net.feedbackSource.begin(), net.feedbackSource.end());
+  vector<uint32_t> innovations(net.innovation.begin(), net.innovation.end());
+
+  string data;
+  data.append((const char*)&header, sizeof(header));
+  data.append((const char*)binaryNodes.data(), binaryNodes.size() * sizeof(BinaryNode));
+  data.append((const char*)sources.data(), sources.size() * sizeof(uint32_t));
+  data.append((const char*)(genome->data() + net.numNodes), sources.size() * sizeof(float));
+  if (header.version >= 2) {
+    data.append((const char*)&numFeedback, sizeof(numFeedback));
+    data.append((const char*)feedbackCounts.data(), feedbackCounts.size() * sizeof(uint32_t));
+    data.append((const char*)feedbackSources.data(), numFeedback * sizeof(uint32_t));
+    data.append((const char*)(genome->data() + net.numNodes + sources.size()),
+                numFeedback * sizeof(float));
+  }
+  if (header.version >= 4)
+    data.append((const char*)innovations.data(), innovations.size() * sizeof(uint32_t));
+  return data;
+}
+
+void NeuralNetwork::forget(const string &filename) {
+  // The file may be rewritten within the resolution of its modification time
+  lock_guard<mutex> lock(registryMutex);
+  auto entry = registry.find(filename);
+  if (entry != registry.end()) {
+    delete entry->second.network;
+    registry.erase(entry);
+  }
+}
+
 NeuralNetwork NeuralNetwork::load(const string &filename) {
-  vector<Node*> nodes;
-  vector<int> netInputs;
-  vector<int> netOutputs;
+  Structure structure;
+  vector<float> baselines, weights, feedbackWeights;
+  structure.start.push_back(0);
+  structure.feedbackStart.push_back(0);
   ifstream input(filename);
 
+  // Files starting with the magic number are in the binary format
+  char magic[sizeof(BINARY_MAGIC)];
+  if (input.read(magic, sizeof(magic)) && memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0)
+    return loadBinary(filename);
+  input.clear();
+  input.seekg(0);
+
   // Check if the file can be opened
   if (input.is_open()) {
     string line;
@@ -227,7 +633,7 @@ NeuralNetwork NeuralNetwork::load(const string &filename) {
     for (int lineNum = 1; getline(input, line); lineNum++) {
       if (!isAllWhitespace(line)) {
         // Parse line into type, name, and value.  
-        regex lineParse("[ ]*(input|output|)[ ]?node[ ]+([0-9]+)(?:[ ]+default[ ]+(-?[0-9]+(?:\\.[0-9]+)?))?(?:[ ]+connected to[ ]+([-0-9\\.e: ]+))?(?:#.*)?");
+        regex lineParse("[ ]*(input|output|)[ ]?node[ ]+([0-9]+)(?:[ ]+innovation[ ]+([0-9]+))?(?:[ ]+default[ ]+(-?[0-9]+(?:\\.[0-9]+)?))?(?:[ ]+activation[ ]+(linear|tanh|sigmoid))?(?:[ ]+connected to[ ]+([-0-9\\.e: ]+))?(?:[ ]+feedback from[ ]+([-0-9\\.e: ]+))?(?:#.*)?");
         smatch parseResult; // parseResult[0] is the whole string
         if (!regex_match(line, parseResult, lineParse)) {
           cerr << "Syntax error when parsing neural network description file " << filename << " at line " << lineNum << endl;
@@ -235,12 +641,15 @@ NeuralNetwork NeuralNetwork::load(const string &filename) {
         }
         string type = parseResult[1];
         int id = stoi(parseResult[2]);
-        float baseline =
+        int innovation =
           ((string)parseResult[3]).size() > 0?
-          stof(parseResult[3]) : 0;
-        string connections = parseResult[4];
-        vector<Node*> inputs;
-        vector<float> weights;
+          stoi(parseResult[3]) : id;
+        float baseline =
+          ((string)parseResult[4]).size() > 0?
+          stof(parseResult[4]) : 0;
+        string activation = parseResult[5];
+        string connections = trim_right_copy((string)parseResult[6]);
+        string feedback = trim_right_copy((string)parseResult[7]);
 
         regex connectionParse("[ ]*([0-9]+)[ ]*\\:[ ]*(-?[0-9]+(?:\\.[0-9]+)?(?:e-?[0-9]+)?)([ ]*[0-9][-0-9\\.e: ]+)?");
         while (connections != "") {
@@ -249,27 +658,47 @@ NeuralNetwork NeuralNetwork::load(const string &filename) {
             exit(1);
           }
           int newId = stoi(parseResult[1]);
-          if (newId >= (int)nodes.size()) {
+          if (newId >= (int)baselines.size()) {
             cerr << "Error when parsing neural network description file " << filename << " at line " << lineNum <<
               ": Undefined node id " << newId << endl;
             exit(1);
           }
-          inputs.push_back(nodes[newId]);
+          structure.source.push_back(newId);
           weights.push_back(stof(parseResult[2]));
           connections = parseResult[3];
         }
 
+        // Feedback connections may come from any node, which is checked once all are read
+        while (feedback != "") {
+          if (!regex_match(feedback, parseResult, connectionParse)) {
+            cerr << "Syntax error when parsing feedback connections in neural network description file " << filename << " at line " << lineNum << endl;
+            exit(1);
+          }
+          structure.feedbackSource.push_back(stoi(parseResult[1]));
+          feedbackWeights.push_back(stof(parseResult[2]));
+          feedback = parseResult[3];
+        }
+
         if (id != checkId++) {
           cerr << "Error when parsing neural network description file " << filename << " at line " << lineNum <<
             ": Node ids must be sequential and start at 0" << endl;
           exit(1);
         }
-        Node *newNode = new Node(id, type == "input", type == "output", baseline, inputs, weights);
-        nodes.push_back(newNode);
+        baselines.push_back(baseline);
+        structure.start.push_back(structure.source.size());
+        structure.feedbackStart.push_back(structure.feedbackSource.size());
+        structure.isInput.push_back(type == "input");
+        structure.isOutput.push_back(type == "output");
+        structure.activation.push_back(networkkernel::LINEAR);
+        for (int a = 0; a < networkkernel::NUM_ACTIVATIONS; a++) {
+          if (activation == networkkernel::getActivationName((networkkernel::Activation)a))
+            structure.activation.back() = a;
+        }
+        structure.innovation.push_back(innovation);
         if (type == "input")
-          netInputs.push_back(id);
+          structure.inputs.push_back(id);
         else if (type == "output")
-          netOutputs.push_back(id);
+          structure.outputs.push_back(id);
       }
     }
     input.close();
@@ -279,7 +708,197 @@ NeuralNetwork NeuralNetwork::load(const string &filename) {
     exit(1);
   }
 
-  return NeuralNetwork(netInputs, netOutputs, nodes);
+  structure.numNodes = baselines.size();
+  for (int source : structure.feedbackSource) {
+    if (source >= (int)structure.numNodes) {
+      cerr << "Error when parsing neural network description file " << filename <<
+        ": Undefined feedback node id " << source << endl;
+      exit(1);
+    }
+  }
+  if (!hasUniqueInnovations(structure)) {
+    cerr << "Error when parsing neural network description file " << filename <<
+      ": Innovation numbers must be unique" << endl;
+    exit(1);
+  }
+  assignStateSlots(structure);
+  std::shared_ptr<Genome> genome = newGenome();
+  genome->insert(genome->end(), baselines.begin(), baselines.end());
+  genome->insert(genome->end(), weights.begin(), weights.end());
+  genome->insert(genome->end(), feedbackWeights.begin(), feedbackWeights.end());
+  return NeuralNetwork(share(structure), genome);
+}
+
+NeuralNetwork NeuralNetwork::loadBinary(const string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat buf;
+  if (fd == -1 || fstat(fd, &buf) != 0) {
+    cerr << "Could not find neural network file " << filename << endl;
+    exit(1);
+  }
+  size_t size = buf.st_size;
+  void *data = size >= sizeof(BinaryHeader)?
+    mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED) {
+    cerr << "Could not read neural network file " << filename << endl;
+    exit(1);
+  }
+
+  NeuralNetwork result = fromBinary(data, size, filename);
+  munmap(data, size);
+  return result;
+}
+
+NeuralNetwork NeuralNetwork::fromBinary(const void *data, size_t size, const string &filename) {
+  if (size < sizeof(BinaryHeader) || memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+    cerr << "Error when loading neural network file " << filename <<
+      ": Not a binary network" << endl;
+    exit(1);
+  }
+  const BinaryHeader *header = (const BinaryHeader*)data;
+  if (header->version < 1 || header->version > BINARY_VERSION) {
+    cerr << "Error when loading neural network file " << filename <<
+      ": Unsupported version " << header->version << endl;
+    exit(1);
+  }
+  size_t expectedSize = sizeof(BinaryHeader) +
+    (size_t)header->numNodes * sizeof(BinaryNode) +
+    (size_t)header->numConnections * (sizeof(uint32_t) + sizeof(float));
+  uint32_t numFeedback = 0;
+  if (header->version >= 2 && size >= expectedSize + sizeof(uint32_t)) {
+    numFeedback = *(const uint32_t*)((const char*)data + expectedSize);
+    expectedSize += sizeof(uint32_t) +
+      (size_t)header->numNodes * sizeof(uint32_t) +
+      (size_t)numFeedback * (sizeof(uint32_t) + sizeof(float));
+  }
+  if (header->version >= 4)
+    expectedSize += (size_t)header->numNodes * sizeof(uint32_t);
+  if (size != expectedSize) {
+    cerr << "Error when loading neural network file " << filename <<
+      ": Expected " << expectedSize << " bytes but found " << size << endl;
+    exit(1);
+  }
+  const BinaryNode *binaryNodes = (const BinaryNode*)(header + 1);
+  const uint32_t *sources = (const uint32_t*)(binaryNodes + header->numNodes);
+  const float *weights = (const float*)(sources + header->numConnections);
+  const uint32_t *feedbackCounts = (const uint32_t*)(weights + header->numConnections) + 1;
+  const uint32_t *feedbackSources = feedbackCounts + header->numNodes;
+  const float *feedbackWeights = (const float*)(feedbackSources + numFeedback);
+  const uint32_t *innovations = (const uint32_t*)(feedbackWeights + numFeedback);
+
+  // Connections are stored in node order, so each node's connections start where the
+  // last node's end
+  Structure structure;
+  structure.numNodes = header->numNodes;
+  structure.start.push_back(0);
+  structure.feedbackStart.push_back(0);
+  std::shared_ptr<Genome> genome = newGenome();
+  genome->resize(header->numNodes + header->numConnections + numFeedback);
+  for (uint32_t id = 0; id < header->numNodes; id++) {
+    const BinaryNode &binaryNode = binaryNodes[id];
+    if (binaryNode.firstConnection != structure.start.back() ||
+        (uint64_t)binaryNode.firstConnection + binaryNode.numConnections > header->numConnections) {
+      cerr << "Error when loading neural network file " << filename <<
+        ": Connections of node " << id << " are out of range" << endl;
+      exit(1);
+    }
+    for (uint32_t i = 0; i < binaryNode.numConnections; i++) {
+      uint32_t source = sources[binaryNode.firstConnection + i];
+      if (source >= id) {
+        cerr << "Error when loading neural network file " << filename <<
+          ": Node " << id << " is connected to undefined node id " << source << endl;
+        exit(1);
+      }
+      structure.source.push_back(source);
+    }
+    structure.start.push_back(structure.source.size());
+
+    uint32_t nodeFeedback = header->version >= 2? feedbackCounts[id] : 0;
+    if (structure.feedbackSource.size() + nodeFeedback > numFeedback) {
+      cerr << "Error when loading neural network file " << filename <<
+        ": Feedback connections of node " << id << " are out of range" << endl;
+      exit(1);
+    }
+    for (uint32_t i = 0; i < nodeFeedback; i++) {
+      uint32_t source = feedbackSources[structure.feedbackSource.size()];
+      if (source >= header->numNodes) {
+        cerr << "Error when loading neural network file " << filename <<
+          ": Node " << id << " has feedback from undefined node id " << source << endl;
+        exit(1);
+      }
+      structure.feedbackSource.push_back(source);
+    }
+    structure.feedbackStart.push_back(structure.feedbackSource.size());
+
+    bool isInput = binaryNode.flags & BINARY_INPUT;
+    bool isOutput = !isInput && (binaryNode.flags & BINARY_OUTPUT);
+    structure.isInput.push_back(isInput);
+    structure.isOutput.push_back(isOutput);
+    uint32_t activation = header->version >= 3?
+      (binaryNode.flags & BINARY_ACTIVATION_MASK) >> BINARY_ACTIVATION_SHIFT : 0;
+    if (activation >= networkkernel::NUM_ACTIVATIONS) {
+      cerr << "Error when loading neural network file " << filename <<
+        ": Node " << id << " has an unknown activation" << endl;
+      exit(1);
+    }
+    structure.activation.push_back(activation);
+    uint32_t innovation = header->version >= 4? innovations[id] : id;
+    if (innovation > INT_MAX) {
+      cerr << "Error when loading neural network file " << filename <<
+        ": Node " << id << " has an invalid innovation number" << endl;
+      exit(1);
+    }
+    structure.innovation.push_back(innovation);
+    if (isInput)
+      structure.inputs.push_back(id);
+    else if (isOutput)
+      structure.outputs.push_back(id);
+    (*genome)[id] = binaryNode.baseline;
+  }
+  if (structure.feedbackSource.size() != numFeedback) {
+    cerr << "Error when loading neural network file " << filename <<
+      ": Expected " << numFeedback << " feedback connections but found " <<
+      structure.feedbackSource.size() << endl;
+    exit(1);
+  }
+  memcpy(genome->data() + header->numNodes, weights, header->numConnections * sizeof(float));
+  memcpy(genome->data() + header->numNodes + header->numConnections,
+         feedbackWeights, numFeedback * sizeof(float));
+  if (!hasUniqueInnovations(structure)) {
+    cerr << "Error when loading neural network file " << filename <<
+      ": Innovation numbers must be unique" << endl;
+    exit(1);
+  }
+  assignStateSlots(structure);
+
+  return NeuralNetwork(share(structure), genome);
+}
+
+NeuralNetwork NeuralNetwork::get(const string &filename) {
+  struct stat buf;
+  if (stat(filename.c_str(), &buf) != 0)
+    return load(filename); // Reports the missing file
+
+  lock_guard<mutex> lock(registryMutex);
+  RegistryEntry &entry = registry[filename];
+  if (entry.network == NULL ||
+      entry.mtime.tv_sec != buf.st_mtim.tv_sec ||
+      entry.mtime.tv_nsec != buf.st_mtim.tv_nsec ||
+      entry.size != buf.st_size) {
+    // Networks already handed out keep the old nodes alive
+    delete entry.network;
+    entry.network = new NeuralNetwork(load(filename));
+    entry.mtime = buf.st_mtim;
+    entry.size = buf.st_size;
+  }
+  return *entry.network;
+}
+
+bool NeuralNetwork::hasUniqueInnovations(const Structure &structure) {
+  vector<int> innovations = structure.innovation;
+  sort(innovations.begin(), innovations.end());
+  return adjacent_find(innovations.begin(), innovations.end()) == innovations.end();
 }
 
 bool NeuralNetwork::isAllWhitespace(const string &line) {
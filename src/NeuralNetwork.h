@@ -2,57 +2,31 @@
 /**
  * \author Lucas Kramer
  * \file  NeuralNetwork.h
- * \brief A feed-forward neural network class
+ * \brief A neural network class, with optional recurrent connections
  */
 
+#include <stdint.h>
+#include <string>
 #include <vector>
-#include <mutex>
+#include <memory>
 
-/** \brief A representation of a neural network */
-class NeuralNetwork {
-  /** \brief A node in a neural network */
-  struct Node {
-    int id;
-    bool isInput;
-    bool isOutput;
-    float baseline;
-    std::vector<Node*> inputs;
-    std::vector<float> weights;
-
-    /**
-     * The node constructor
-     * \param id the id of the node
-     * \param isInput is the node an input to the simulation
-     * \param isOutput is the node an output to the simulation
-     * \param baseline the output of the node when there is no stimulation
-     * \param inputs the input nodes to the node
-     * \param weights the weights by which to scale the inputs to the node
-     */
-    Node(int id, bool isInput, bool isOutput, float baseline,
-         const std::vector<Node*> &inputs,
-         const std::vector<float> &weights);
-
-    /**
-     * The node destructor
-     */
-    ~Node();
-    
-    /**
-     * Notify the node that a reference to it has been added,
-     * used for node garbage collection
-     */
-    void attatch();
-
-    /**
-     * Notify the node that a reference to it has been removed,
-     * used for node garbage collection
-     */
-    void detatch();
-
-  private:
-    int numReferences;
-  };
+#include "networkkernel.h"
+#include "RandomStream.h"
 
+/**
+ * \brief A representation of a neural network
+ * \details Each node's value is its baseline plus the sum of its inputs' values scaled by
+ * the connection weights, passed through the node's activation function, which is linear
+ * unless the network file gives another.  Connections normally come from earlier nodes,
+ * but feedback connections read the value any node had on the previous computation,
+ * which is kept in state storage supplied by the caller.  
+ * Every node also has an innovation number, which identifies it across networks whose
+ * structures have grown apart, so that they can still be combined.  Nodes from a file
+ * without innovation numbers use their ids, and nodes added by addNode get the same
+ * number in every network when they split the same connection.  A connection is
+ * identified by the innovation numbers of the nodes it joins.  
+ */
+class NeuralNetwork {
 public:
   /**
    * The copy constructor
@@ -61,7 +35,7 @@ public:
   NeuralNetwork(const NeuralNetwork &other);
 
   /**
-   * Constructs a network from a file description
+   * Constructs a network from a file description, through the registry used by get
    * \param filename the description filename
    */
   NeuralNetwork(const std::string &filename);
@@ -72,71 +46,343 @@ public:
   ~NeuralNetwork();
 
   /**
-   * Computes the output values of a network for a vector of inputs.  
+   * Computes the output values of a network for a vector of inputs, with any feedback
+   * connections reading 0.  
    * Throws an exception if an incorrect number of inputs is provided
    * \param inputs a vector containing the inputs
    * \return a vector containing the outputs
    */
-  std::vector<float> compute(const std::vector<float> &inputs);
+  std::vector<float> compute(const std::vector<float> &inputs) const;
+
+  /**
+   * Computes the output values of a network without allocating.  The network isn't
+   * modified, so it and its copies can be computed from several threads at once as
+   * long as each uses its own scratch space.  
+   * \param inputs getNumInputs() input values
+   * \param outputs space for getNumOutputs() output values
+   * \param scratch space for getScratchSize() values used during the computation
+   * \param state getStateSize() values read by the feedback connections, which are
+   * replaced by the values from this computation.  The state should start as 0, and may
+   * be NULL if the state size is 0.  
+   */
+  void compute(const float *inputs, float *outputs, float *scratch,
+               float *state = NULL) const;
+
+  /**
+   * Computes the output values of a network for a batch of input sets at once.  Each
+   * node is computed for the whole batch before moving on to the next, so the work for
+   * each connection is a loop over the batch.  The results are the same as computing
+   * each set separately.  
+   * \param inputs count sets of getNumInputs() input values, one after another
+   * \param outputs space for count sets of getNumOutputs() output values
+   * \param count the number of input sets
+   * \param scratch space for count * getScratchSize() values used during the computation
+   * \param state count sets of getStateSize() state values, one after another
+   */
+  void compute(const float *inputs, float *outputs, unsigned count, float *scratch,
+               float *state = NULL) const;
+
+  /**
+   * Gets the amount of scratch space needed to compute one set of inputs
+   * \return the number of values
+   */
+  unsigned getScratchSize() const;
+
+  /**
+   * Gets the amount of state kept between computations for the feedback connections
+   * \return the number of values, 0 for a feed-forward network
+   */
+  unsigned getStateSize() const;
+
+  /**
+   * Gets the name of the evaluator used by compute for a single set of inputs
+   * \return the name of the network's topology if it has a specialized evaluator, or
+   * "generic"
+   */
+  const char *getEvaluatorName() const;
+
+  /**
+   * Gets a copy of the network with the same weights, but with an activation function
+   * on every node except the inputs
+   * \param activation the activation
+   * \return the new network
+   */
+  NeuralNetwork withActivation(networkkernel::Activation activation) const;
+
+  /**
+   * Checks if two networks are copies of each other that share their weights, and
+   * can therefore be computed in the same batch
+   * \param other the other network
+   * \return true if the networks share their weights
+   */
+  bool sharesWeights(const NeuralNetwork &other) const;
+
+  /**
+   * Gets the number of outputs the network produces
+   * \return the number of outputs
+   */
+  unsigned getNumOutputs() const;
+
+  /**
+   * Gets the number of inputs the network expects
+   * \return the number of inputs
+   */
+  unsigned getNumInputs() const;
 
   /**
    * Mutates the network by changing numChanged connection strengths by
    * a random number between -amount and amount
    * \param numChanged the number of connections to mutate
    * \param amount the maximum amount to change the connections
+   * \param random the stream to draw the changes from
    * \return the new network
    */
-  NeuralNetwork mutate(int numChanged, float amount);
+  NeuralNetwork mutate(int numChanged, float amount, RandomStream &random) const;
+
+  /**
+   * Mutates the network in place, like mutate.  The network's weights are only copied
+   * first if they are shared with another network.  
+   * \param numChanged the number of connections to mutate
+   * \param amount the maximum amount to change the connections
+   * \param random the stream to draw the changes from
+   */
+  void mutateInPlace(int numChanged, float amount, RandomStream &random);
+
+  /**
+   * Adds a node to the network in place by splitting a random connection in two.  The
+   * new node is linear with a baseline of 0, and the connection into it has a weight of
+   * 1, so the network computes the same values as before.  The structure is patched
+   * rather than rebuilt, and the weights are only copied first if they are shared.  
+   * \param random the stream to choose the connection from
+   * \return false if the network has no connections, or the chosen connection was
+   * split before, in which case the network is unchanged
+   */
+  bool addNode(RandomStream &random);
+
+  /**
+   * Adds a connection to the network in place between two random nodes that aren't
+   * already connected, with a random weight between -amount and amount.  The structure
+   * is patched rather than rebuilt, and the weights are only copied first if they are
+   * shared.  
+   * \param amount the largest magnitude of the weight
+   * \param random the stream to choose the nodes and weight from
+   * \return false if no unconnected pair of nodes was found, in which case the network is
+   * unchanged
+   */
+  bool addConnection(float amount, RandomStream &random);
 
   /**
    * Combines the network with another network by constructing a new network
-   * with half the connection strengths from each.  Throws an exception if
-   * the networks have incompatible structures
+   * with half the connection strengths from each.  The new network has this network's
+   * structure, and nodes and connections the other network doesn't have keep this
+   * network's weights.  Throws an exception if the networks have different inputs
+   * or outputs
    * \return the new network
    */
-  NeuralNetwork combine(const NeuralNetwork &other);
+  NeuralNetwork combine(const NeuralNetwork &other) const;
 
   /**
    * Writes the network to a file
    * \param filename the file to write
    */
-  void write(const std::string &filename);
+  void write(const std::string &filename) const;
+
+  /**
+   * Writes the network to a file in the binary format, which stores weights exactly and
+   * is loaded without any parsing
+   * \param filename the file to write
+   */
+  void writeBinary(const std::string &filename) const;
+
+  /**
+   * Gets the contents of a binary network file for the network, without writing it
+   * \return the contents
+   */
+  std::string toBinary() const;
 
   /**
-   * Loads a network from a file
+   * Loads a network from a file in either the text or the binary format
    * \param filename the filename to load
    * \return the new network
    */
   static NeuralNetwork load(const std::string &filename);
 
+  /**
+   * Loads a network from the contents of a binary network file already in memory
+   * \param data the contents
+   * \param size the size of the contents in bytes
+   * \param filename the name to report errors with
+   * \return the new network
+   */
+  static NeuralNetwork fromBinary(const void *data, size_t size, const std::string &filename);
+
+  /**
+   * Gets a network from a file through a process-wide registry.  Each file is only
+   * loaded again when its modification time or size changes, and the networks handed
+   * out share their weights with the registry's copy.  
+   * \param filename the filename to load
+   * \return the network
+   */
+  static NeuralNetwork get(const std::string &filename);
+
 private:
-  std::mutex computeMutex;
-  std::vector<int> inputs;
-  std::vector<int> outputs;
-  std::vector<Node*> nodes;
+  /**
+   * \brief The structure of a network: its inputs and outputs, and the nodes each node
+   * is connected to.  Structures never change once built, and every network with the
+   * same structure shares one, so a network itself only holds its genome.  
+   * \details Node ids are in topological order, since a node may only be connected to
+   * nodes before it, so nodes are computed in id order.  Feedback connections may come
+   * from any node, and read a state slot holding the node's previous value.  
+   */
+  struct Structure {
+    unsigned numNodes;
+    std::vector<int> inputs;      // The node for each network input
+    std::vector<int> outputs;     // The node for each network output
+    std::vector<char> isInput;    // Whether each node is an input
+    std::vector<char> isOutput;   // Whether each node is an output
+    std::vector<char> activation; // The activation function of each node
+    std::vector<int> innovation;  // The innovation number of each node
+    std::vector<unsigned> start;  // The first connection of each node, and the end
+    std::vector<int> source;      // The node each connection comes from
+    std::vector<unsigned> feedbackStart; // The first feedback connection of each node, and the end
+    std::vector<int> feedbackSource;     // The node each feedback connection comes from
+    std::vector<int> feedbackSlot;       // The state slot each feedback connection reads
+    std::vector<int> stateNodes;         // The node saved in each state slot
+
+    // The evaluator specialized for the structure, if there is one
+    const networkkernel::Topology *topology;
+
+    /**
+     * Checks if two structures are the same
+     * \param other the other structure
+     * \return true if they are the same
+     */
+    bool operator==(const Structure &other) const;
+  };
+
+  /**
+   * \brief The parameters of a network: the baseline of every node, then the weight of
+   * every connection, then the weight of every feedback connection, all in node order.  
+   * Genomes are only modified when they aren't shared, and are recycled through a pool
+   * once no network uses them.  
+   */
+  typedef std::vector<float> Genome;
+
+  std::shared_ptr<const Structure> structure;
+  std::shared_ptr<Genome> genome;
+
+  /**
+   * Constructs a NeuralNetwork from its structure and genome
+   * \param structure the structure
+   * \param genome the genome
+   */
+  NeuralNetwork(const std::shared_ptr<const Structure> &structure,
+                const std::shared_ptr<Genome> &genome);
+
+  /**
+   * Gets the shared copy of a structure, after finding its specialized evaluator if it
+   * is a new structure that has one
+   * \param structure the structure, which is moved from
+   * \return the shared structure
+   */
+  static std::shared_ptr<const Structure> share(Structure &structure);
 
   /**
-   * Constructs a NeuralNetwork from vectors of inputs, outputs, and the nodes
-   * \param inputs the ids of the input nodes
-   * \param outputs the ids of the output nodes
-   * \param nodes the nodes
+   * Assigns the state slots of a structure's feedback connections, one for each node
+   * read by them in node order
+   * \param structure the structure
    */
-  NeuralNetwork(const std::vector<int> &inputs,
-                const std::vector<int> &outputs,
-                const std::vector<Node*> &nodes);
+  static void assignStateSlots(Structure &structure);
 
-  // Private members and functions used for evaluation
-  std::vector<float> nodeValue;
-  std::vector<bool> nodeComputed;
-  std::vector<int> inputIndex;
+  /**
+   * Gets the innovation number of the node added by splitting a connection.  It only
+   * depends on the nodes the connection joins, so it is the same in every network and
+   * every process.  
+   * \param source the innovation number of the connection's source node
+   * \param target the innovation number of the connection's target node
+   * \return the innovation number, at least FIRST_SPLIT_INNOVATION
+   */
+  static int splitInnovation(int source, int target);
+
+  // The smallest innovation number given to nodes added by addNode, above any node id
+  // used in a network file
+  static const int FIRST_SPLIT_INNOVATION = 1 << 16;
+
+  /**
+   * Gets the weights of the network for modifying, after copying them if they are
+   * shared with another network
+   * \return the genome
+   */
+  Genome &getUnsharedGenome();
+
+  /**
+   * Helper function for combine, combines networks with different structures by
+   * matching their nodes and connections by innovation number
+   * \param other the other network
+   * \return the new network
+   */
+  NeuralNetwork combineAligned(const NeuralNetwork &other) const;
+
+  /**
+   * Gets an empty genome, reusing the storage of a genome that is no longer used if
+   * there is one
+   * \return the genome
+   */
+  static std::shared_ptr<Genome> newGenome();
+
+  /**
+   * \brief The header of a binary network file.  It is followed by a BinaryNode for
+   * each node, then the source node id of every connection, then the weight of every
+   * connection, with each node's connections stored together in node order.  
+   * \details Version 2 files have feedback connections, stored after the weights as
+   * their total number, then the number for each node, then their source node ids,
+   * then their weights.  Version 3 files also have node activations in the flags, and
+   * version 4 files end with the innovation number of each node.  Files are written with
+   * the lowest version that can hold the network.  
+   */
+  struct BinaryHeader {
+    char magic[4];           // BINARY_MAGIC
+    uint32_t version;        // At most BINARY_VERSION
+    uint32_t numNodes;
+    uint32_t numConnections;
+  };
+
+  /** \brief A node in a binary network file */
+  struct BinaryNode {
+    uint32_t flags;           // BINARY_INPUT, BINARY_OUTPUT and the activation
+    float baseline;
+    uint32_t firstConnection;
+    uint32_t numConnections;
+  };
+
+  static const char BINARY_MAGIC[4];
+  static const uint32_t BINARY_VERSION = 4;
+  static const uint32_t BINARY_INPUT = 1;
+  static const uint32_t BINARY_OUTPUT = 2;
+  static const uint32_t BINARY_ACTIVATION_SHIFT = 2;
+  static const uint32_t BINARY_ACTIVATION_MASK = 3 << BINARY_ACTIVATION_SHIFT;
+
+  /**
+   * Helper function for load, loads a file in the binary format by mapping it into memory
+   * \param filename the filename to load
+   * \return the new network
+   */
+  static NeuralNetwork loadBinary(const std::string &filename);
+
+  /**
+   * Helper function for write and writeBinary,
+   * drops the registry's copy of a file that has been rewritten
+   * \param filename the file
+   */
+  static void forget(const std::string &filename);
 
   /**
-   * Computes the value of a node if it hasn't been computed
-   * \param inputs the input values to the node
-   * \param node the node to compute
-   * \return the value of the node
+   * Helper function for load and loadBinary,
+   * checks that no two nodes have the same innovation number
+   * \param structure the structure to check
+   * \return true if every innovation number is different
    */
-  float computeNode(const std::vector<float> &inputs, const Node &node);
+  static bool hasUniqueInnovations(const Structure &structure);
 
   /**
    * Helper function for load,
@@ -14,6 +14,7 @@
 #include <GL/glu.h>
 #include <GL/glut.h>
 #include <stdexcept>
+#include <algorithm>
 
 #include "Environment.h"
 #include "Robot.h"
@@ -31,7 +32,14 @@ NeuralNetworkRobot::NeuralNetworkRobot(int radius,
                                        Environment *env) :
   Robot(NEURAL_NETWORK, radius, color, lineColor, targetId, env),
   filename(filename),
-  network(network) {}
+  network(network),
+  inputs(network.getNumInputs()),
+  scratch(network.getScratchSize()),
+  state(network.getStateSize()),
+  batchTime(-1) {
+  if (network.getNumOutputs() != 2)
+    throw new invalid_argument("Neural network robots need a network with 2 outputs");
+}
 
 NeuralNetworkRobot::NeuralNetworkRobot(int radius,
                                        Location loc,
@@ -43,34 +51,108 @@ NeuralNetworkRobot::NeuralNetworkRobot(int radius,
                                        Environment *env) :
   Robot(NEURAL_NETWORK, radius, loc, color, lineColor, targetId, env),
   filename(filename),
-  network(network) {}
+  network(network),
+  inputs(network.getNumInputs()),
+  scratch(network.getScratchSize()),
+  state(network.getStateSize()),
+  batchTime(-1) {
+  if (network.getNumOutputs() != 2)
+    throw new invalid_argument("Neural network robots need a network with 2 outputs");
+}
 
 NeuralNetworkRobot::~NeuralNetworkRobot() {}
 
-float NeuralNetworkRobot::getLeftSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                                       float leftRobotSensorVal, float rightRobotSensorVal,
-                                       float leftObstacleSensorVal, float rightObstacleSensorVal,
-                                       float leftTargetSensorVal, float rightTargetSensorVal) {
+unsigned NeuralNetworkRobot::getSensorsUsed() const {
+  // The light sensors aren't network inputs, and the range sensors are only used by
+  // networks with inputs left over after the other sensors
+  const SensorArray &sensors = getSensors();
+  unsigned numInputs = sensors.size();
+  for (unsigned i = 0; i < sensors.size(); i++) {
+    if (sensors[i].getTypeDetected() == LIGHT)
+      numInputs--;
+  }
   return
-    network.compute({
-        leftRobotSensorVal, rightRobotSensorVal,
-          leftObstacleSensorVal, rightObstacleSensorVal,
-          leftTargetSensorVal * GET_FLOAT("TARGET_SENSOR_SCALE"),
-          rightTargetSensorVal * GET_FLOAT("TARGET_SENSOR_SCALE")})[0] *
-    GET_FLOAT("SPEED_SCALE_FACTOR") *
-    GET_FLOAT("NEURAL_NETWORK_SPEED_SCALE");
+    sensorBit(ROBOT) | sensorBit(OBSTACLE) | sensorBit(TARGET) |
+    (network.getNumInputs() > numInputs? RANGE_SENSOR_BIT : 0);
 }
 
-float NeuralNetworkRobot::getRightSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                                        float leftRobotSensorVal, float rightRobotSensorVal,
-                                        float leftObstacleSensorVal, float rightObstacleSensorVal,
-                                        float leftTargetSensorVal, float rightTargetSensorVal) {
-  return
-    network.compute({
-        leftRobotSensorVal, rightRobotSensorVal,
-          leftObstacleSensorVal, rightObstacleSensorVal,
-          leftTargetSensorVal * GET_FLOAT("TARGET_SENSOR_SCALE"),
-          rightTargetSensorVal * GET_FLOAT("TARGET_SENSOR_SCALE")})[1] *
-    GET_FLOAT("SPEED_SCALE_FACTOR") *
-    GET_FLOAT("NEURAL_NETWORK_SPEED_SCALE");
+void NeuralNetworkRobot::getInputs(const SensorReadings &readings, float *inputs) const {
+  const SensorArray &sensors = *readings.layout;
+  unsigned numInputs = network.getNumInputs();
+  unsigned n = 0;
+  for (unsigned i = 0; i < sensors.size(); i++) {
+    if (sensors[i].getTypeDetected() != LIGHT && n == numInputs)
+      throw new invalid_argument("Neural network has fewer inputs than the robot has sensors");
+    switch (sensors[i].getTypeDetected()) {
+    case LIGHT:
+      break;
+    case TARGET:
+      inputs[n++] = readings.values[i] * GET_FLOAT("TARGET_SENSOR_SCALE");
+      break;
+    default:
+      inputs[n++] = readings.values[i];
+    }
+  }
+
+  for (unsigned i = 0; n < numInputs; i++)
+    inputs[n++] = i < readings.range.size()? readings.range[i] : 0;
+}
+
+WheelSpeeds NeuralNetworkRobot::getWheelSpeeds(const SensorReadings &readings) {
+  if (GET_BOOL("BATCH_NEURAL_NETWORKS")) {
+    if (batchTime != env->getTime())
+      computeBatch();
+    return batchSpeeds;
+  }
+
+  float outputs[2];
+  getInputs(readings, inputs.data());
+  network.compute(inputs.data(), outputs, scratch.data(), state.data());
+  return getSpeeds(outputs);
+}
+
+void NeuralNetworkRobot::computeBatch() {
+  static thread_local vector<NeuralNetworkRobot*> batch;
+  static thread_local vector<float> batchInputs, batchOutputs, batchScratch, batchState;
+  int time = env->getTime();
+  unsigned numInputs = network.getNumInputs();
+  unsigned stateSize = network.getStateSize();
+
+  batch.clear();
+  for (PhysicalObject *o : *env) {
+    if (o->objectType == ROBOT && ((Robot*)o)->robotType == NEURAL_NETWORK) {
+      NeuralNetworkRobot *r = (NeuralNetworkRobot*)o;
+      if (r->batchTime != time && r->network.sharesWeights(network))
+        batch.push_back(r);
+    }
+  }
+
+  batchInputs.resize(batch.size() * numInputs);
+  batchOutputs.resize(batch.size() * 2);
+  batchScratch.resize(batch.size() * network.getScratchSize());
+  batchState.resize(batch.size() * stateSize);
+  for (unsigned i = 0; i < batch.size(); i++) {
+    NeuralNetworkRobot *r = batch[i];
+    r->readSensors();
+    r->getInputs(r->getReadings(), &batchInputs[i * numInputs]);
+    copy(r->state.begin(), r->state.end(), batchState.begin() + i * stateSize);
+  }
+  network.compute(batchInputs.data(), batchOutputs.data(), batch.size(),
+                  batchScratch.data(), batchState.data());
+  for (unsigned i = 0; i < batch.size(); i++) {
+    NeuralNetworkRobot *r = batch[i];
+    r->batchSpeeds = getSpeeds(&batchOutputs[i * 2]);
+    r->batchTime = time;
+    copy(batchState.begin() + i * stateSize, batchState.begin() + (i + 1) * stateSize,
+         r->state.begin());
+  }
+}
+
+WheelSpeeds NeuralNetworkRobot::getSpeeds(const float *outputs) {
+  float scale = GET_FLOAT("SPEED_SCALE_FACTOR");
+  float networkScale = GET_FLOAT("NEURAL_NETWORK_SPEED_SCALE");
+  WheelSpeeds speeds;
+  speeds.left  = outputs[0] * scale * networkScale;
+  speeds.right = outputs[1] * scale * networkScale;
+  return speeds;
 }
@@ -7,7 +7,7 @@
 
 #include "PhysicalObject.h"
 #include "Robot.h"
-#include "Sensor.h"
+#include "SensorArray.h"
 #include "NeuralNetwork.h"
 #include "configuration.h"
 
@@ -33,18 +33,40 @@ public:
 
   ~NeuralNetworkRobot();
 
-  float getLeftSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                     float leftRobotSensorVal, float rightRobotSensorVal,
-                     float leftObstacleSensorVal, float rightObstacleSensorVal,
-                     float leftTargetSensorVal, float rightTargetSensorVal);
-  float getRightSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                      float leftRobotSensorVal, float rightRobotSensorVal,
-                      float leftObstacleSensorVal, float rightObstacleSensorVal,
-                      float leftTargetSensorVal, float rightTargetSensorVal);
+  unsigned getSensorsUsed() const;
+  WheelSpeeds getWheelSpeeds(const SensorReadings &readings);
 
   const std::string filename;
 
 private:
   NeuralNetwork network;
+  std::vector<float> inputs, scratch;
+  std::vector<float> state; // The network's feedback state, carried between updates
+  int batchTime;
+  WheelSpeeds batchSpeeds;
+
+  /**
+   * Reads the sensors of every neural network robot in the environment that shares
+   * this robot's network and hasn't updated yet in this step, and computes all of their
+   * wheel speeds in one batch.  
+   */
+  void computeBatch();
+
+  /**
+   * Converts the network's outputs to wheel speeds
+   * \param outputs the network outputs
+   * \return the wheel speeds
+   */
+  static WheelSpeeds getSpeeds(const float *outputs);
+
+  /**
+   * Builds the network inputs from the sensor readings.  The inputs are every sensor
+   * except the light sensors, in layout order, with the target sensors scaled by
+   * TARGET_SENSOR_SCALE.  Networks with more inputs than that get the range sensor
+   * readings as the remaining inputs, padded with 0 if there are not enough.  
+   * \param readings the sensor readings
+   * \param inputs space for the network's inputs
+   */
+  void getInputs(const SensorReadings &readings, float *inputs) const;
 };
 
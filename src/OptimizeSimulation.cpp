@@ -6,21 +6,24 @@
  */
 
 #include <unistd.h>
+#include <time.h>
 #include <stdlib.h> 
 #include <signal.h>
 #include <algorithm>
 #include <vector>
+#include <deque>
+#include <set>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include <stdexcept>
 #include <sstream>
 #include <fstream>
+#include <iterator>
 #include <iostream>
 #include <climits>
 #include <csignal>
-#include <sys/stat.h>
-#include <boost/interprocess/sync/named_upgradable_mutex.hpp>
 using namespace std;
-using namespace boost::interprocess;
 
 #include "Robot.h"
 #include "SimpleRobot.h"
@@ -39,20 +42,54 @@ using namespace util;
 
 OptimizeSimulation *OptimizeSimulation::s_currentInstance;
 
-OptimizeSimulation::OptimizeSimulation(int argc, char* argv[]) :
-  lock(open_or_create, GET_STRING("NEURAL_NETWORK_LOCK_NAME").c_str()) {
+OptimizeSimulation::OptimizeSimulation(int argc, char* argv[], const string &defaultConfig) :
+  poolFile(GET_STRING("POOL_FILE"), GET_INT("MAX_POOL_SIZE"), GET_INT("POOL_SLOT_SIZE")),
+  evaluationCache(GET_STRING("EVALUATION_CACHE_FILE")),
+  scenarioHash(getScenarioHash(argc, argv, defaultConfig)),
+  // Processes started together still need different seeds
+  seed((uint64_t)time(NULL) << 32 | getpid()) {
   s_currentInstance = this;
   //sigemptyset(&sigint);
   //sigaddset(&sigint, SIGINT);
   signal(SIGINT, stopHandler);
-  lock.lock_sharable();
-  reload();
-  lock.unlock_sharable();
-  startedEmpty = false;
+
+  // The rungs must run more random trials each, but fewer than the full evaluation
+  istringstream rungs(GET_STRING("FIDELITY_RUNGS"));
+  int numTrials;
+  while (rungs >> numTrials) {
+    if (numTrials <= (fidelityRungs.size() > 0? fidelityRungs.back() : 0) ||
+        numTrials >= GET_INT("NUM_OPTIMIZE_TRIALS")) {
+      cerr << "FIDELITY_RUNGS must increase and be less than NUM_OPTIMIZE_TRIALS" << endl;
+      exit(1);
+    }
+    fidelityRungs.push_back(numTrials);
+  }
+  if (!rungs.eof()) {
+    cerr << "Could not parse FIDELITY_RUNGS " << GET_STRING("FIDELITY_RUNGS") << endl;
+    exit(1);
+  }
+  rungHistory.resize(fidelityRungs.size());
+
+  unsigned numSlots = poolFile.getNumSlots();
+  slotNetwork.resize(numSlots, NULL);
+  slotPerformance.resize(numSlots);
+  slotSequence.resize(numSlots);
+  poolFileRevision = poolFile.getRevision();
+  for (unsigned i = 0; i < numSlots; i++)
+    loadSlot(i);
+  sortPool();
+
   if (pool.size() == 0) {
-    startedEmpty = true;
-    pool.push_back(new NeuralNetwork(GET_STRING("OPTIMAL_NEURAL_NETWORK_FILE")));
-    poolPerformance.push_back(getPerformance(*pool.back()));
+    NeuralNetwork *network = new NeuralNetwork(GET_STRING("OPTIMAL_NEURAL_NETWORK_FILE"));
+    int performance = evaluate(*network);
+    // Another process may have started the pool meanwhile
+    poolFile.lock();
+    refresh();
+    if (pool.size() == 0 && store(0, network, performance))
+      sortPool();
+    else if (pool.size() > 0)
+      delete network;
+    poolFile.unlock();
   }
 }
 
@@ -60,251 +97,328 @@ OptimizeSimulation::~OptimizeSimulation() {
   for (PhysicalObject *o : *Environment::getEnv()) {
     delete o;
   }
-  for (NeuralNetwork *net : pool) {
+  for (NeuralNetwork *net : slotNetwork) {
     delete net;
   }
 }
 
 void OptimizeSimulation::runMainLoop() {
-  int lastUpdateTime = getFileTimestamp(GET_STRING("BEST_PERFORMANCE_FILE"));
-  bool poolChanged = startedEmpty;
+  // Each worker simulates its candidates in its own environment.  The first worker runs
+  // on this thread, so with one worker everything happens as it did without threads.  
+  int numThreads = GET_INT("OPTIMIZE_THREADS");
+  if (numThreads <= 0)
+    numThreads = max(thread::hardware_concurrency(), 1u);
+  vector<thread> workers;
+  for (int i = 1; i < numThreads; i++) {
+    workers.push_back(thread([this, i]() {
+          runWorker(i);
+          delete Environment::getEnv();
+        }));
+  }
+  runWorker(0);
+  for (thread &worker : workers)
+    worker.join();
 
+  cout << "Found " << evaluationCache.getNumHits() << " of " <<
+    evaluationCache.getNumLookups() << " evaluations in the cache" << endl;
+  if (fidelityRungs.size() > 0)
+    cout << "Skipped " << numTrialsSkipped << " of " << numTrialsFull <<
+      " trials by dropping networks at lower rungs (" << getLadderSavings() << "%)" << endl;
+}
+
+void OptimizeSimulation::runWorker(int worker) {
+  // Each worker makes its candidates from its own stream
+  RandomStream random(seed, worker);
   while (!stopRequest) {
-    int oldOptimalPerformance;
-    if (poolPerformance.size() > 0)
-      oldOptimalPerformance = poolPerformance.front();
-    else
-      oldOptimalPerformance = -1;
+    // Candidates are made while holding the pool, and evaluated after releasing it
+    unique_lock<mutex> poolLock(poolMutex);
+    if (refresh() && GET_BOOL("OPTIMIZE_VERBOSE"))
+      cout << "Refreshing..." << endl;
+    if (pool.size() == 0) {
+      cerr << "The pool in " << GET_STRING("POOL_FILE") << " is empty" << endl;
+      exit(1);
+    }
 
-    if (((float)rand()) / ((float)RAND_MAX) < GET_FLOAT("COMBINE_FREQUENCY")) {
-      int netId1 = rand() % (pool.size() > (unsigned)GET_INT("SUB_POOL_SIZE")?
-                             GET_INT("SUB_POOL_SIZE") : pool.size());
-      int netId2 = rand() % pool.size();
+    bool combining = random.nextFloat() < GET_FLOAT("COMBINE_FREQUENCY");
+    NeuralNetwork *newNetwork;
+    int oldPerformance = 0;
+    unsigned parentSlot = 0;
+    uint32_t parentSequence = 0;
+    if (combining) {
+      int netId1 = random.nextInt(pool.size() > (unsigned)GET_INT("SUB_POOL_SIZE")?
+                                  GET_INT("SUB_POOL_SIZE") : pool.size());
+      int netId2 = random.nextInt(pool.size());
       if (GET_BOOL("OPTIMIZE_VERBOSE"))
         cout << "Combining network " << netId1 << " with " << netId2 << endl;
-      NeuralNetwork *newNetwork =
-        new NeuralNetwork(pool[netId1]->
-                          combine(*pool[netId2]).
-                          mutate(GET_INT("COMBINE_NUM_CONNECTIONS_MUTATED"),
-                                 GET_FLOAT("COMBINE_MUTATION_AMOUNT")));
-      newNetwork->write(GET_STRING("TEMP_NEURAL_NETWORK_FILE"));
-      int newPerformance = getPerformance(*newNetwork);
-    
-      lock.lock_upgradable();
-      int newUpdateTime = getFileTimestamp(GET_STRING("BEST_PERFORMANCE_FILE"));
-      if (lastUpdateTime != newUpdateTime) {
-        if (GET_BOOL("OPTIMIZE_VERBOSE"))
-          cout << "Refreshing..." << endl;
-        lastUpdateTime = newUpdateTime;
-        reload();
-      }
-
-      if (find(poolPerformance.begin(), poolPerformance.end(), newPerformance) == poolPerformance.end()) {
-        int oldOptimalPerformance;
-        if (poolPerformance.size() > 0)
-          oldOptimalPerformance = poolPerformance.front();
-        else
-          oldOptimalPerformance = -1;
-        pool.push_back(newNetwork);
-        poolPerformance.push_back(newPerformance);
-        unsigned i;
-        for (i = pool.size() - 1; i > 0; i--) {
-          if (poolPerformance[i] < poolPerformance[i - 1]) {
-            NeuralNetwork *temp = pool[i];
-            pool[i] = pool[i - 1];
-            pool[i - 1] = temp;
-            int tempP = poolPerformance[i];
-            poolPerformance[i] = poolPerformance[i - 1];
-            poolPerformance[i - 1] = tempP;
-            poolChanged = true;
-          }
-          else break;
-        }
-
-        if (newPerformance < oldOptimalPerformance || oldOptimalPerformance == -1)
-          cout << "\033[1;31mFound optimal network with performance " << newPerformance << "\033[0m" << endl;
-        else if (i != pool.size() - 1 && GET_BOOL("POOL_FOUND_VERBOSE"))
-          cout << "Found pool network with performance " << newPerformance << endl;
-      }
+      newNetwork = new NeuralNetwork(pool[netId1]->combine(*pool[netId2]));
+      newNetwork->mutateInPlace(GET_INT("COMBINE_NUM_CONNECTIONS_MUTATED"),
+                                GET_FLOAT("COMBINE_MUTATION_AMOUNT"), random);
     }
     else {
-      int netId = rand() % pool.size();
+      int netId = random.nextInt(pool.size());
       if (GET_BOOL("OPTIMIZE_VERBOSE"))
         cout << "Mutating network " << netId << endl;
-      NeuralNetwork *newNetwork =
+      newNetwork =
         new NeuralNetwork(pool[netId]->
                           mutate(GET_INT("NUM_CONNECTIONS_MUTATED"),
-                                 GET_FLOAT("MUTATION_AMOUNT")));
-      newNetwork->write(GET_STRING("TEMP_NEURAL_NETWORK_FILE"));
-      int oldPerformance = poolPerformance[netId];
-      int newPerformance = getPerformance(*newNetwork);
-    
-      lock.lock_upgradable();
-      // This may cause duplicate performances, but they will have different structures
-      // because it is unlikley that one network is mutated into a copy of another
-      if (newPerformance < oldPerformance) {
-        int newUpdateTime = getFileTimestamp(GET_STRING("BEST_PERFORMANCE_FILE"));
-        if (lastUpdateTime != newUpdateTime) {
-          if (GET_BOOL("OPTIMIZE_VERBOSE"))
-            cout << "Refreshing..." << endl;
-          lastUpdateTime = newUpdateTime;
-          reload();
-          
-          vector<int>::iterator loc = find(poolPerformance.begin(), poolPerformance.end(), oldPerformance);
-          if (loc != poolPerformance.end()) {
-            netId = loc - poolPerformance.begin();
-            if (pool[netId] != NULL) {
-              delete pool[netId];
-            }
-            pool[netId] = newNetwork;
-            poolPerformance[netId] = newPerformance;
-            poolChanged = true;
-          }
-          else {
-            netId = poolPerformance.size();
-            pool.push_back(newNetwork);
-            poolPerformance.push_back(newPerformance);
-          }
-        }
-        else {
-          if (pool[netId] != NULL) {
-            delete pool[netId];
-          }
-          pool[netId] = newNetwork;
-          poolPerformance[netId] = newPerformance;
-          poolChanged = true;
-        }
+                                 GET_FLOAT("MUTATION_AMOUNT"), random));
+      if (random.nextFloat() < GET_FLOAT("ADD_NODE_FREQUENCY") &&
+          newNetwork->addNode(random) && GET_BOOL("OPTIMIZE_VERBOSE"))
+        cout << "Added a node" << endl;
+      if (random.nextFloat() < GET_FLOAT("ADD_CONNECTION_FREQUENCY") &&
+          newNetwork->addConnection(GET_FLOAT("MUTATION_AMOUNT"), random) &&
+          GET_BOOL("OPTIMIZE_VERBOSE"))
+        cout << "Added a connection" << endl;
+      oldPerformance = poolPerformance[netId];
+      parentSlot = poolSlot[netId];
+      parentSequence = slotSequence[parentSlot];
+    }
 
-        for (; netId > 0; netId--) {
-          if (poolPerformance[netId] < poolPerformance[netId - 1]) {
-            NeuralNetwork *temp = pool[netId];
-            pool[netId] = pool[netId - 1];
-            pool[netId - 1] = temp;
-            int tempP = poolPerformance[netId];
-            poolPerformance[netId] = poolPerformance[netId - 1];
-            poolPerformance[netId - 1] = tempP;
-            poolChanged = true;
-          }
-          else break;
-        }
+    // A candidate is only kept if it beats its parent, or the worst network in a full pool
+    int bound;
+    if (!combining)
+      bound = oldPerformance;
+    else if (pool.size() == poolFile.getNumSlots())
+      bound = poolPerformance.back();
+    else
+      bound = INT_MAX;
+    poolLock.unlock();
 
-        if (newPerformance < oldOptimalPerformance || oldOptimalPerformance == -1)
-          cout << "\033[1;31mFound optimal network by improvment with performance " << newPerformance << "\033[0m" << endl;
-        else if ((unsigned)netId != pool.size() - 1 && GET_BOOL("POOL_FOUND_VERBOSE"))
-          cout << "Improved pool network with performance " << oldPerformance << " to " << newPerformance << endl;
-      }
+    // Each worker keeps the candidate it is evaluating in its own file
+    newNetwork->write(GET_STRING("TEMP_NEURAL_NETWORK_FILE") +
+                      (worker > 0? "_" + to_string(worker) : ""));
+
+    int newPerformance = evaluate(*newNetwork, bound);
+    numCandidates++;
+    if (newPerformance >= bound) {
+      numRejectedEarly++;
+      // Networks dropped by the ladder were already reported
+      if (GET_BOOL("OPTIMIZE_VERBOSE") && newPerformance != INT_MAX)
+        cout << "Rejected network early, it can't beat " << bound << " (" <<
+          numRejectedEarly << " of " << numCandidates << " rejected early)" << endl;
+      delete newNetwork;
+      continue;
     }
 
-    if (pool.size() > (unsigned)GET_INT("MAX_POOL_SIZE")) {
-      delete pool.back();
-      pool.pop_back();
-      poolPerformance.pop_back();
+    poolLock.lock();
+    poolFile.lock();
+    if (refresh() && GET_BOOL("OPTIMIZE_VERBOSE"))
+      cout << "Refreshing..." << endl;
+    int oldOptimalPerformance = pool.size() > 0? poolPerformance.front() : -1;
+
+    int slot = -1;
+    if (combining) {
+      if (find(poolPerformance.begin(), poolPerformance.end(), newPerformance) == poolPerformance.end())
+        slot = findSlot(newPerformance);
     }
-    
-    if (GET_BOOL("PRINT_POOL")) {
-      for (unsigned i = 0; i < pool.size(); i++) {
-        cout << poolPerformance[i] << endl;
-      }
+    else if (newPerformance < oldPerformance) {
+      // This may cause duplicate performances, but they will have different structures
+      // because it is unlikley that one network is mutated into a copy of another.  
+      // The network replaces its parent, unless another worker or process replaced the
+      // parent first.  
+      if (slotSequence[parentSlot] == parentSequence)
+        slot = parentSlot;
+      else
+        slot = findSlot(newPerformance);
     }
 
-    if (poolChanged) {
-      poolChanged = false;
-      //sigprocmask(SIG_BLOCK, &sigint, NULL);
-      lock.unlock_upgradable_and_lock();
+    if (slot != -1 && store(slot, newNetwork, newPerformance)) {
+      sortPool();
+      if (newPerformance < oldOptimalPerformance || oldOptimalPerformance == -1) {
+        cout << "\033[1;31mFound optimal network" << (combining? "" : " by improvment") <<
+          " with performance " << newPerformance << "\033[0m" << endl;
+        pool.front()->write(GET_STRING("OPTIMAL_NEURAL_NETWORK_FILE"));
+      }
+      else if (GET_BOOL("POOL_FOUND_VERBOSE")) {
+        if (combining)
+          cout << "Found pool network with performance " << newPerformance << endl;
+        else
+          cout << "Improved pool network with performance " << oldPerformance << " to " << newPerformance << endl;
+      }
 
-      bool clearPerformances =
-        pool.size() == (unsigned)GET_INT("MAX_POOL_SIZE") &&
-        poolPerformance.back() - poolPerformance.front() < GET_INT("MIN_DIVERSITY");
-      if (clearPerformances)
+      if (pool.size() == poolFile.getNumSlots() &&
+          poolPerformance.back() - poolPerformance.front() < GET_INT("MIN_DIVERSITY")) {
         cout << "Found low performance diversity, performing bottleneck" << endl;
-      ofstream performanceOut(GET_STRING("BEST_PERFORMANCE_FILE"));
+        for (unsigned i = 1; i < pool.size(); i++) {
+          poolFile.clear(poolSlot[i]);
+          loadSlot(poolSlot[i]);
+        }
+        sortPool();
+      }
+    }
+    else if (slot == -1)
+      delete newNetwork;
+    poolFile.unlock();
+
+    if (GET_BOOL("PRINT_POOL")) {
       for (unsigned i = 0; i < pool.size(); i++) {
-        pool[i]->write(getPoolFile(i));
-        if (!clearPerformances || i == 0)
-          performanceOut << poolPerformance[i] << endl;
+        cout << poolPerformance[i] << endl;
       }
-      performanceOut.close();
-      pool.front()->write(GET_STRING("OPTIMAL_NEURAL_NETWORK_FILE"));
+    }
+  }
+}
 
-      lastUpdateTime = getFileTimestamp(GET_STRING("BEST_PERFORMANCE_FILE"));
+bool OptimizeSimulation::refresh() {
+  uint32_t revision = poolFile.getRevision();
+  if (revision == poolFileRevision)
+    return false;
+  poolFileRevision = revision;
 
-      //sigprocmask(SIG_UNBLOCK, &sigint, NULL);
-      lock.unlock();
+  // Only the slots written since they were read need to be read again
+  bool changed = false;
+  for (unsigned i = 0; i < slotNetwork.size(); i++) {
+    if (poolFile.getSequence(i) != slotSequence[i]) {
+      loadSlot(i);
+      changed = true;
     }
-    else 
-      lock.unlock_upgradable();
   }
+  if (changed)
+    sortPool();
+  return changed;
 }
 
-void OptimizeSimulation::stop() {
-  stopRequest = true;
+void OptimizeSimulation::loadSlot(unsigned slot) {
+  delete slotNetwork[slot];
+  slotSequence[slot] = poolFile.read(slot, slotNetwork[slot], slotPerformance[slot]);
 }
 
-int OptimizeSimulation::getFileTimestamp(string filename) {
-  struct stat buf;
-  stat(filename.c_str(), &buf);
-  return buf.st_mtime;
+bool OptimizeSimulation::store(unsigned slot, NeuralNetwork *network, int performance) {
+  if (!poolFile.write(slot, *network, performance)) {
+    cerr << "Network is too large for a pool slot, increase POOL_SLOT_SIZE" << endl;
+    delete network;
+    return false;
+  }
+  delete slotNetwork[slot];
+  slotNetwork[slot] = network;
+  slotPerformance[slot] = performance;
+  slotSequence[slot] = poolFile.getSequence(slot);
+  return true;
 }
 
-string OptimizeSimulation::getPoolFile(int i) {
-  return GET_STRING("POOL_NEURAL_NETWORK_BASE_FILE").append(to_string(i));
+int OptimizeSimulation::findSlot(int performance) {
+  if (pool.size() < slotNetwork.size())
+    return find(slotNetwork.begin(), slotNetwork.end(), (NeuralNetwork*)NULL) - slotNetwork.begin();
+  else if (performance < poolPerformance.back())
+    return poolSlot.back();
+  else
+    return -1;
 }
 
-void OptimizeSimulation::reload() {
-  ifstream performanceIn(GET_STRING("BEST_PERFORMANCE_FILE"));
-  if (performanceIn.is_open()) {
-    poolPerformance.clear();
-    int performance;
-    for (int i = 0; i < GET_INT("MAX_POOL_SIZE") && performanceIn >> performance; i++) {
-      poolPerformance.push_back(performance);
-      if (GET_BOOL("OPTIMIZE_VERBOSE"))
-        cout << "Read performance " << i << ": " << performance << endl;
-    }
-  }
-  else {
-    cerr << "Could not find performance file " << GET_STRING("BEST_PERFORMANCE_FILE") << endl;
-    exit(1);
-  }
-  performanceIn.close();
-  
-  for (unsigned i = 0; i < pool.size(); i++) {
-    delete pool[i];
+void OptimizeSimulation::sortPool() {
+  poolSlot.clear();
+  for (unsigned i = 0; i < slotNetwork.size(); i++) {
+    if (slotNetwork[i] != NULL)
+      poolSlot.push_back(i);
   }
+  stable_sort(poolSlot.begin(), poolSlot.end(), [this](unsigned a, unsigned b) {
+      return slotPerformance[a] < slotPerformance[b];
+    });
   pool.clear();
-  for (unsigned i = 0; i < poolPerformance.size(); i++) {
-    pool.push_back(new NeuralNetwork(getPoolFile(i)));
+  poolPerformance.clear();
+  for (unsigned slot : poolSlot) {
+    pool.push_back(slotNetwork[slot]);
+    poolPerformance.push_back(slotPerformance[slot]);
   }
 }
 
-int OptimizeSimulation::getPerformance(const NeuralNetwork &network) {
-  int result = 0;
-  int newSeed = rand();
-  srand(123456); // Seed RNG with constant seed so trials are repeatable
-  result += getPerformanceRandomRepeated(network);
+void OptimizeSimulation::stop() {
+  stopRequest = true;
+}
+
+int OptimizeSimulation::getPerformance(const NeuralNetwork &network, int bound) {
+  return finishPerformance(network, bound, 0, 0);
+}
+
+int OptimizeSimulation::finishPerformance(const NeuralNetwork &network, int bound,
+                                          int trialsRun, int steps) {
+  int result = steps;
+  result += runTrials(network, getRandomTrials(trialsRun, GET_INT("NUM_OPTIMIZE_TRIALS")),
+                      min(bound, GET_INT("STEP_LIMIT")) - steps);
 //  result += getPerformanceMaze(network);
-  result += getPerformanceObstacles(network);
-  srand(newSeed); // Re-seed RNG
-  if (GET_BOOL("OPTIMIZE_VERBOSE"))
+  if (result < bound)
+    result += getPerformanceObstacles(network, bound - result);
+  if (GET_BOOL("OPTIMIZE_VERBOSE") && result < bound)
     cout << "Found performance " << result << endl;
   return result;
 }
 
-int OptimizeSimulation::getPerformanceRandomRepeated(const NeuralNetwork &network) {
-  int result = 0;
-  for (int i = 0; i < GET_INT("NUM_OPTIMIZE_TRIALS"); i++) {
-    reset();
-    for (int j = 0; j < GET_INT("NUM_OPTIMIZE_ROBOTS_TARGETS"); j++)
-      addNeuralNetworkRobotTarget(network);
-    for (int j = 0; j < GET_INT("NUM_OPTIMIZE_OBSTACLES"); j++)
-      addObstacle();
-    while (getNumRobotsTargets() > 0 && result < GET_INT("STEP_LIMIT")) {
-      advance();
-      result++;
+int OptimizeSimulation::evaluate(const NeuralNetwork &network, int bound) {
+  string binary = network.toBinary();
+  uint64_t key = EvaluationCache::hash(binary.data(), binary.size(), scenarioHash);
+  int result;
+  if (evaluationCache.find(key, result)) {
+    if (GET_BOOL("OPTIMIZE_VERBOSE"))
+      cout << "Found cached performance " << result << " (" << evaluationCache.getNumHits() <<
+        " of " << evaluationCache.getNumLookups() << " evaluations cached)" << endl;
+    return result;
+  }
+
+  // Candidates climb the ladder of rungs, each running more of the random trials, and
+  // only go on to the next rung if they are among the best recent candidates at this one.  
+  // The random trials run at each rung are the first ones of the full evaluation, so the
+  // full evaluation only runs the rest.  Rung trials aren't stopped at the candidate's
+  // bound, and every candidate reaching a rung is ranked there, even one past its bound, so
+  // the history at each rung isn't skewed towards the candidates with the loosest bounds.  
+  int numTrials = GET_INT("NUM_OPTIMIZE_TRIALS") + GET_INT("NUM_OPTIMIZE_OBSTACLES_TRIALS") / 2 * 2;
+  numTrialsFull += numTrials;
+  int steps = 0, trialsRun = 0;
+  for (unsigned rung = 0; rung < fidelityRungs.size(); rung++) {
+    steps += runTrials(network, getRandomTrials(trialsRun, fidelityRungs[rung]),
+                       GET_INT("STEP_LIMIT") - steps);
+    trialsRun = fidelityRungs[rung];
+    bool promoted = promote(rung, steps);
+    if (steps >= bound)
+      return steps;
+    if (!promoted) {
+      numTrialsSkipped += numTrials - trialsRun;
+      if (GET_BOOL("OPTIMIZE_VERBOSE"))
+        cout << "Dropped network at rung " << rung << " after " << trialsRun <<
+          " trials with " << steps << " steps (" << getLadderSavings() <<
+          "% of trials skipped)" << endl;
+      return INT_MAX;
     }
   }
+
+  // A stopped evaluation only shows the network is worse than the bound
+  result = finishPerformance(network, bound, trialsRun, steps);
+  if (result < bound)
+    evaluationCache.insert(key, result);
   return result;
 }
 
+bool OptimizeSimulation::promote(unsigned rung, int steps) {
+  lock_guard<mutex> lock(ladderMutex);
+  deque<int> &history = rungHistory[rung];
+  unsigned historySize = GET_INT("FIDELITY_HISTORY");
+
+  // Every candidate goes on until there are enough others at the rung to rank it against
+  unsigned numBetter = count_if(history.begin(), history.end(),
+                                [steps](int other) { return other < steps; });
+  bool promoted =
+    history.size() < historySize ||
+    numBetter < GET_FLOAT("FIDELITY_PROMOTE_FRACTION") * history.size();
+  history.push_back(steps);
+  while (history.size() > historySize)
+    history.pop_front();
+  return promoted;
+}
+
+double OptimizeSimulation::getLadderSavings() const {
+  unsigned long long full = numTrialsFull;
+  return full > 0? 100.0 * numTrialsSkipped / full : 0;
+}
+
+int OptimizeSimulation::getPerformanceRandomRepeated(const NeuralNetwork &network, int bound) {
+  return runTrials(network, getRandomTrials(0, GET_INT("NUM_OPTIMIZE_TRIALS")), bound);
+}
+
+vector<OptimizeSimulation::Trial> OptimizeSimulation::getRandomTrials(int first, int last) {
+  vector<Trial> trials;
+  for (int i = first; i < last; i++)
+    trials.push_back(Trial{RANDOM_TRIAL, i});
+  return trials;
+}
+
 int OptimizeSimulation::getPerformanceMaze(const NeuralNetwork &network) {
   int result = 0;
   open("../runtime/neuralnetwork/setups/maze.rsim");
@@ -330,29 +444,173 @@ int OptimizeSimulation::getPerformanceMaze(const NeuralNetwork &network) {
 }
 
 
-int OptimizeSimulation::getPerformanceObstacles(const NeuralNetwork &network) {
+int OptimizeSimulation::getPerformanceObstacles(const NeuralNetwork &network, int bound) {
+  vector<Trial> trials;
+  for (int i = 0; i < GET_INT("NUM_OPTIMIZE_OBSTACLES_TRIALS") / 2; i++)
+    trials.push_back(Trial{OBSTACLES1_TRIAL, i});
+  for (int i = 0; i < GET_INT("NUM_OPTIMIZE_OBSTACLES_TRIALS") / 2; i++)
+    trials.push_back(Trial{OBSTACLES2_TRIAL, i});
+  return runTrials(network, trials, bound);
+}
+
+int OptimizeSimulation::runTrials(const NeuralNetwork &network, const vector<Trial> &trials,
+                                  int bound) {
+  int stepLimit = min(GET_INT("STEP_LIMIT"), bound);
+  int numThreads = min(GET_INT("OPTIMIZE_TRIAL_THREADS"), (int)trials.size());
   int result = 0;
-  open("../runtime/neuralnetwork/setups/obstacles1.rsim");
-  for (int i = 0; i < GET_INT("NUM_OPTIMIZE_OBSTACLES_TRIALS") / 2; i++) {
-    for (int j = 0; j < GET_INT("NUM_OPTIMIZE_OBSTACLES_ROBOTS_TARGETS"); j++)
-      addNeuralNetworkRobotTarget(network);
-    while (getNumRobotsTargets() > 0 && result < GET_INT("STEP_LIMIT")) {
-      advance();
-      result++;
+  if (numThreads <= 1) {
+    // Each trial only gets the steps that are left, since the total is limited anyway
+    for (const Trial &trial : trials) {
+      if (result >= stepLimit)
+        break;
+      result += runTrial(network, trial, stepLimit - result);
     }
+    return result;
+  }
+
+  // Each trial gets the whole limit since the others may not have finished yet, and the
+  // total is limited afterwards, which gives the same result.  No more trials are started
+  // once the finished ones reach the limit.  
+  atomic<int> total(0);
+  atomic<unsigned> next(0);
+  auto runNext = [&]() {
+    for (unsigned i = next++; i < trials.size() && total < stepLimit; i = next++)
+      total += runTrial(network, trials[i], stepLimit);
+  };
+  vector<thread> helpers;
+  for (int i = 1; i < numThreads; i++) {
+    helpers.push_back(thread([&]() {
+          runNext();
+          delete Environment::getEnv();
+        }));
   }
-  open("../runtime/neuralnetwork/setups/obstacles2.rsim");
-  for (int i = 0; i < GET_INT("NUM_OPTIMIZE_OBSTACLES_TRIALS") / 2; i++) {
+  runNext();
+  for (thread &helper : helpers)
+    helper.join();
+  return min((int)total, stepLimit);
+}
+
+int OptimizeSimulation::runTrial(const NeuralNetwork &network, const Trial &trial,
+                                 int stepLimit) {
+  Environment::getEnv()->seedRandom(getTrialSeed(trial));
+  if (trial.type == RANDOM_TRIAL) {
+    // A setup opened by an earlier trial may have changed the size
+    reset();
+    Environment::getEnv()->setWidth(GET_INT("DISPLAY_WIDTH"));
+    Environment::getEnv()->setHeight(GET_INT("DISPLAY_HEIGHT"));
+    for (int j = 0; j < GET_INT("NUM_OPTIMIZE_ROBOTS_TARGETS"); j++)
+      addNeuralNetworkRobotTarget(network);
+    for (int j = 0; j < GET_INT("NUM_OPTIMIZE_OBSTACLES"); j++)
+      addObstacle();
+  }
+  else {
+    open(trial.type == OBSTACLES1_TRIAL?
+         "../runtime/neuralnetwork/setups/obstacles1.rsim" :
+         "../runtime/neuralnetwork/setups/obstacles2.rsim");
     for (int j = 0; j < GET_INT("NUM_OPTIMIZE_OBSTACLES_ROBOTS_TARGETS"); j++)
       addNeuralNetworkRobotTarget(network);
-    while (getNumRobotsTargets() > 0 && result < GET_INT("STEP_LIMIT")) {
-      advance();
-      result++;
-    }
+  }
+
+  int result = 0;
+  while (getNumRobotsTargets() > 0 && result < stepLimit) {
+    advance();
+    result++;
   }
   return result;
 }
 
+unsigned OptimizeSimulation::getTrialSeed(const Trial &trial) {
+  // Mix the trial into the seed, so that trials next to each other get unrelated seeds
+  uint64_t x = (uint64_t)TRIAL_SEED << 32 ^ (uint64_t)trial.type << 24 ^ trial.index;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+uint64_t OptimizeSimulation::getScenarioHash(int argc, char* argv[], const string &defaultConfig) {
+  // Settings given as arguments override the files, so they are written after them
+  string config = defaultConfig;
+  vector<string> addedConfigs;
+  stringstream arguments;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--use-config" && i + 1 < argc)
+      config = argv[++i];
+    else if (arg == "--add-config" && i + 1 < argc)
+      addedConfigs.push_back(argv[++i]);
+    else if (arg.substr(0, 2) == "-D" && i + 2 < argc) {
+      if (!isVerbositySetting(arg.substr(2)) && !isSearchSetting(arg.substr(2)))
+        arguments << arg << " " << argv[i + 1] << " " << argv[i + 2] << endl;
+      i += 2;
+    }
+  }
+
+  stringstream scenario;
+  set<string> written;
+  writeConfigFile(config, scenario, written);
+  for (const string &addedConfig : addedConfigs)
+    writeConfigFile(addedConfig, scenario, written);
+  scenario << arguments.str();
+  for (string setup : {"../runtime/neuralnetwork/setups/obstacles1.rsim",
+                       "../runtime/neuralnetwork/setups/obstacles2.rsim"}) {
+    ifstream input(setup);
+    scenario << string(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+  }
+  scenario << TRIAL_SEED << endl;
+  string definition = scenario.str();
+  return EvaluationCache::hash(definition.data(), definition.size());
+}
+
+void OptimizeSimulation::writeConfigFile(const string &filename, ostream &scenario,
+                                         set<string> &written) {
+  if (!written.insert(filename).second)
+    return;
+  ifstream input(filename);
+  if (!input) {
+    cerr << "Could not read configuration file " << filename << endl;
+    exit(1);
+  }
+
+  // Files that are used are named relative to the file using them
+  string dir = filename.substr(0, filename.find_last_of('/') + 1);
+  string line;
+  while (getline(input, line)) {
+    stringstream words(line);
+    string type, name;
+    words >> type >> name;
+    if (type == "" || type[0] == '#')
+      continue;
+    if (type == "use" && name.size() >= 2 && name[0] == '"')
+      writeConfigFile(dir + name.substr(1, name.find('"', 1) - 1), scenario, written);
+    else if (!isVerbositySetting(name) && !isSearchSetting(name))
+      scenario << line << endl;
+  }
+}
+
+bool OptimizeSimulation::isVerbositySetting(const string &name) {
+  return name.find("VERBOSE") != string::npos ||
+    name.compare(0, 6, "PRINT_") == 0 || name.compare(0, 6, "DEBUG_") == 0;
+}
+
+bool OptimizeSimulation::isSearchSetting(const string &name) {
+  static const set<string> searchSettings = {
+    // How the optimizer runs, which scripts/test_trial_threads checks for trial threads
+    "OPTIMIZE_SIMULATION", "EVALUATE_NETWORK", "OPTIMIZE_THREADS", "OPTIMIZE_TRIAL_THREADS",
+    // Where files are kept
+    "INSTALL_DIR", "WORKING_DIR", "INITIAL_SIMULATION_FILE", "DEFAULT_NEURAL_NETWORK_FILE",
+    "TEMP_NEURAL_NETWORK_FILE", "OPTIMAL_NEURAL_NETWORK_FILE", "POOL_FILE", "POOL_SLOT_SIZE",
+    "EVALUATION_CACHE_FILE",
+    // How candidates are made and chosen, but not how they are evaluated
+    "FIDELITY_RUNGS", "FIDELITY_PROMOTE_FRACTION", "FIDELITY_HISTORY", "MAX_POOL_SIZE",
+    "SUB_POOL_SIZE", "MIN_DIVERSITY", "NUM_CONNECTIONS_MUTATED", "MUTATION_AMOUNT",
+    "ADD_NODE_FREQUENCY", "ADD_CONNECTION_FREQUENCY", "COMBINE_FREQUENCY",
+    "COMBINE_NUM_CONNECTIONS_MUTATED", "COMBINE_MUTATION_AMOUNT"};
+  return searchSettings.count(name) > 0;
+}
+
 void OptimizeSimulation::stopHandler(int) {
   s_currentInstance->stop();
 }
@@ -5,8 +5,14 @@
  * \brief Robot simultaion for optimizing the NeuralNetworkRobot
  */
 
+#include <climits>
 #include <vector>
-#include <boost/interprocess/sync/named_upgradable_mutex.hpp>
+#include <deque>
+#include <set>
+#include <string>
+#include <ostream>
+#include <mutex>
+#include <atomic>
 
 #include "Color.h"
 #include "Location.h"
@@ -15,6 +21,8 @@
 #include "util.h"
 #include "PhysicalObject.h"
 #include "NeuralNetwork.h"
+#include "PoolFile.h"
+#include "EvaluationCache.h"
 
 /** \brief OptimizeSimulation class, sets up environments and robots. */
 class OptimizeSimulation {
@@ -24,34 +32,235 @@ public:
    * \brief The constructor for the Simulation class
    * \param argc The number of command-line arguments
    * \param argv The command-line arguments
+   * \param defaultConfig The configuration file loaded unless the arguments give another
    */
-  OptimizeSimulation(int argc, char* argv[]);
+  OptimizeSimulation(int argc, char* argv[], const std::string &defaultConfig);
   virtual ~OptimizeSimulation();
 
+  /**
+   * \brief Repeatedly makes and evaluates new candidate networks, updating the pool,
+   * until stopped.  Candidates are evaluated concurrently by OPTIMIZE_THREADS workers, each
+   * simulating its own environment and sharing the pool held in memory.  The pool is kept
+   * in a PoolFile, so other processes optimizing at the same time share it too.  
+   */
   void runMainLoop();
   void stop();
 
-  int getPerformance(const NeuralNetwork &network);
-  int getPerformanceRandomRepeated(const NeuralNetwork &network);
-  int getPerformanceMaze(const NeuralNetwork &network);
-  int getPerformanceObstacles(const NeuralNetwork &network);
+  /**
+   * \brief Gets the number of steps a network takes to finish every trial, where fewer is
+   * better.  Each trial is set up from its own seed, so trials don't depend on each other
+   * and may run in parallel on OPTIMIZE_TRIAL_THREADS threads with the same result.  
+   * The evaluation stops as soon as the steps reach the bound, since the network is no
+   * use once it can't do better than that.  It doesn't use the pool, so it can be called
+   * without an OptimizeSimulation.  
+   * \param network the network to evaluate
+   * \param bound the number of steps to stop at
+   * \return the number of steps, or the bound if the evaluation was stopped
+   */
+  static int getPerformance(const NeuralNetwork &network, int bound = INT_MAX);
+  static int getPerformanceRandomRepeated(const NeuralNetwork &network, int bound = INT_MAX);
+  static int getPerformanceMaze(const NeuralNetwork &network);
+  static int getPerformanceObstacles(const NeuralNetwork &network, int bound = INT_MAX);
+
+  /**
+   * \brief Gets the performance of a network like getPerformance, but looks it up in the
+   * evaluation cache first.  Complete evaluations are added to the cache.  
+   * If FIDELITY_RUNGS are set, the network is first run on the random trials up to each
+   * rung in turn, and dropped if it isn't in the best FIDELITY_PROMOTE_FRACTION of the last
+   * FIDELITY_HISTORY networks at the rung.  
+   * \param network the network to evaluate
+   * \param bound the number of steps to stop at
+   * \return the number of steps, at least the bound if the evaluation was stopped, or
+   * INT_MAX if the network was dropped at a rung
+   */
+  int evaluate(const NeuralNetwork &network, int bound = INT_MAX);
 
 private:
-  static OptimizeSimulation *s_currentInstance;
+  /** \brief The kinds of trials a network is evaluated on */
+  enum TrialType {RANDOM_TRIAL, OBSTACLES1_TRIAL, OBSTACLES2_TRIAL};
+
+  /** \brief A trial, identified by its kind and its index among trials of that kind */
+  struct Trial {
+    TrialType type;
+    int index;
+  };
+
+  // The seed that the seed of every trial is derived from
+  static const unsigned TRIAL_SEED = 123456;
+
+  /**
+   * \brief Runs a group of trials, spread over OPTIMIZE_TRIAL_THREADS threads, until
+   * their total number of steps reaches STEP_LIMIT or the bound
+   * \param network the network to evaluate
+   * \param trials the trials
+   * \param bound the number of steps to stop at
+   * \return the total number of steps, at most STEP_LIMIT and the bound
+   */
+  static int runTrials(const NeuralNetwork &network, const std::vector<Trial> &trials, int bound);
+
+  /**
+   * \brief Gets the random trials in a range
+   * \param first the index of the first trial
+   * \param last the index after the last trial
+   * \return the trials
+   */
+  static std::vector<Trial> getRandomTrials(int first, int last);
+
+  /**
+   * \brief Finishes evaluating a network like getPerformance, after some of its random
+   * trials have been run
+   * \param network the network to evaluate
+   * \param bound the number of steps to stop at
+   * \param trialsRun the number of random trials that were run
+   * \param steps the number of steps they took
+   * \return the number of steps of every trial, or the bound if the evaluation was stopped
+   */
+  static int finishPerformance(const NeuralNetwork &network, int bound, int trialsRun,
+                               int steps);
+
+  /**
+   * \brief Decides if a network goes on to the next rung of the ladder, and adds it to the
+   * networks it is ranked against at the rung
+   * \param rung the rung
+   * \param steps the number of steps the network took on the rung's trials
+   * \return true if the network goes on
+   */
+  bool promote(unsigned rung, int steps);
+
+  /**
+   * \brief Gets the share of the trials of full evaluations skipped by dropping networks
+   * at lower rungs
+   * \return the percentage of trials
+   */
+  double getLadderSavings() const;
+
+  /**
+   * \brief Sets up a trial in the current environment and runs it
+   * \param network the network to evaluate
+   * \param trial the trial
+   * \param stepLimit the most steps to run
+   * \return the number of steps until every robot found its target, or stepLimit
+   */
+  static int runTrial(const NeuralNetwork &network, const Trial &trial, int stepLimit);
+
+  /**
+   * \brief Derives the seed of a trial, which only depends on the trial
+   * \param trial the trial
+   * \return the seed
+   */
+  static unsigned getTrialSeed(const Trial &trial);
+
+  /**
+   * \brief Hashes the definition of the trials every network is evaluated on: every
+   * setting besides the verbosity and search settings, both in the configuration files
+   * and given as arguments, the setup files the trials open, and the seed they are
+   * derived from.  
+   * \param argc The number of command-line arguments
+   * \param argv The command-line arguments
+   * \param defaultConfig The configuration file loaded unless the arguments give another
+   * \return the hash
+   */
+  static uint64_t getScenarioHash(int argc, char* argv[], const std::string &defaultConfig);
 
-  boost::interprocess::named_upgradable_mutex lock;
+  /**
+   * \brief Helper function for getScenarioHash, writes the settings of a configuration
+   * file and of the files it uses, skipping files that were already written
+   * \param filename the configuration file
+   * \param scenario the stream to write to
+   * \param written the files already written
+   */
+  static void writeConfigFile(const std::string &filename, std::ostream &scenario,
+                              std::set<std::string> &written);
 
-  bool startedEmpty;
+  /**
+   * \brief Helper function for getScenarioHash, checks whether a setting only decides
+   * what is printed, so it is left out of the hash
+   * \param name the name of the setting
+   * \return true if the setting is a verbosity setting
+   */
+  static bool isVerbositySetting(const std::string &name);
 
-  bool stopRequest = false;
+  /**
+   * \brief Helper function for getScenarioHash, checks whether a setting only decides
+   * how the search runs, which candidates it makes or where it keeps its files, so it is
+   * left out of the hash.  Settings added for the optimizer that don't change how a
+   * network performs on the trials belong in this list.  
+   * \param name the name of the setting
+   * \return true if the setting is a search setting
+   */
+  static bool isSearchSetting(const std::string &name);
+
+  static OptimizeSimulation *s_currentInstance;
+
+  PoolFile poolFile;
+  EvaluationCache evaluationCache;
+  uint64_t scenarioHash; // The hash of everything besides the network that decides performance
+  uint64_t seed; // The seed of the workers' streams
+
+  std::atomic<bool> stopRequest{false};
   static void stopHandler(int);
 
-  std::vector<NeuralNetwork*> pool;
+  // Counts of the candidates evaluated, and of those stopped once they couldn't be kept
+  std::atomic<unsigned> numCandidates{0};
+  std::atomic<unsigned> numRejectedEarly{0};
+
+  std::vector<int> fidelityRungs;         // The number of random trials run at each rung
+  std::mutex ladderMutex;                 // Held while using rungHistory
+  std::vector<std::deque<int> > rungHistory; // The steps of the latest networks at each rung
+  std::atomic<unsigned long long> numTrialsFull{0};    // The trials of full evaluations
+  std::atomic<unsigned long long> numTrialsSkipped{0}; // The trials skipped by the ladder
+
+  // The pool and everything below is only used while holding poolMutex
+  std::mutex poolMutex;
+  std::vector<NeuralNetwork*> pool; // The networks in the slots, best first
   std::vector<int> poolPerformance;
+  std::vector<unsigned> poolSlot;   // The slot holding each network
 
-  int getFileTimestamp(std::string filename);
-  std::string getPoolFile(int i);
-  void reload();
+  std::vector<NeuralNetwork*> slotNetwork; // The network in each slot, or NULL
+  std::vector<int> slotPerformance;
+  std::vector<uint32_t> slotSequence;      // The sequence number each slot was read at
+  uint32_t poolFileRevision;               // The revision the slots were checked at
+
+  /**
+   * \brief Runs one worker of runMainLoop on the calling thread
+   * \param worker the number of the worker
+   */
+  void runWorker(int worker);
+
+  /**
+   * \brief Reads the slots written by other processes since they were last checked
+   * \return true if any slot changed
+   */
+  bool refresh();
+
+  /**
+   * \brief Reads a slot from the pool file, replacing the network read from it before
+   * \param slot the slot
+   */
+  void loadSlot(unsigned slot);
+
+  /**
+   * \brief Writes a network to a slot of the pool file.  The file must be locked.  
+   * \param slot the slot
+   * \param network the network, which is owned by the pool afterwards, or deleted if it
+   * didn't fit in the slot
+   * \param performance the performance of the network
+   * \return false if the network didn't fit in the slot
+   */
+  bool store(unsigned slot, NeuralNetwork *network, int performance);
+
+  /**
+   * \brief Finds the slot a new network should go in, either an empty one or the one
+   * with the worst network if the new network is better
+   * \param performance the performance of the new network
+   * \return the slot, or -1 if the network doesn't belong in the pool
+   */
+  int findSlot(int performance);
+
+  /**
+   * \brief Rebuilds the pool from the slots, sorted by performance
+   */
+  void sortPool();
 
   //sigset_t sigint;
 };
@@ -60,8 +60,9 @@ PhysicalObject::PhysicalObject(ObjectType objectType,
   objectType(objectType),
   isHitable(isHitable),
   env(env),
+  random(env->newObjectStream()),
   loc(loc),
-  orientation(rand() % 360),
+  orientation(random.nextInt(360)),
   speed(0),
   radius(radius),
   color(color) {
@@ -85,8 +86,8 @@ Location PhysicalObject::findOpenLocation(Environment *env, int radius) {
   
   // Guess Locations until one that touches nobody is found
   do {
-    result.x = (rand() % (width - radius * 2)) + radius;
-    result.y = (rand() % (height - radius * 2)) + radius;
+    result.x = env->getRandom().nextInt(width - radius * 2) + radius;
+    result.y = env->getRandom().nextInt(height - radius * 2) + radius;
     attempts++;
     
     // Throw exception after many attempts
@@ -113,10 +114,10 @@ Location PhysicalObject::findOpenLocationRandomized(Environment *env,
   
   // Guess Locations until one that touches nobody is found
   do {
-    radius = (rand() % (maxRadius - minRadius)) + minRadius;
+    radius = env->getRandom().nextInt(maxRadius - minRadius) + minRadius;
 
-    result.x = (rand() % (width - radius * 2)) + radius;
-    result.y = (rand() % (height - radius * 2)) + radius;
+    result.x = env->getRandom().nextInt(width - radius * 2) + radius;
+    result.y = env->getRandom().nextInt(height - radius * 2) + radius;
 
     attempts++;
     
@@ -150,6 +151,7 @@ void PhysicalObject::setPosition(float x, float y) {
 
   loc.x = x;
   loc.y = y;
+  env->touch();
 
   updateMembers(); // Update positions of sub-objects
 }
@@ -157,6 +159,7 @@ void PhysicalObject::setPosition(float x, float y) {
 void PhysicalObject::forceSetPosition(float x, float y) {
   loc.x = x;
   loc.y = y;
+  env->touch();
 
   updateMembers();
 }
@@ -170,13 +173,14 @@ void PhysicalObject::setOrientation(int orientation) {
     throw new invalid_argument("setOrientation: Angle out of range.");
   } else {
     this->orientation = orientation;
+    env->touch();
     updateMembers();
   }
 }
 
 void PhysicalObject::reorient(int angle, float distance) {
   // Hack so that it doesn't bother translating after a bunch of tries - prevents infinite recursion
-  static int callDepth = 0;
+  static thread_local int callDepth = 0;
   callDepth++;
   if (callDepth == 1)
     rotate(-angle);
@@ -203,10 +207,12 @@ bool PhysicalObject::translate(float distance) {
     loc.x -= env->getWidth() - 1;
   if (loc.y >= env->getHeight() - 1)
     loc.y -= env->getHeight() - 1;
+  env->touch(); // After moving, so nothing cached from the old position is kept
  
   if (env->getObject(id) != NULL && env->isCollidingWithHitable(id)) {
     int collisionId = env->getHitableCollisionId(id);
     loc = originalPosition;
+    env->touch();
 
     updateMembers();
  
@@ -232,6 +238,7 @@ void PhysicalObject::forceTranslate(float distance) {
   //sin takes radians, therefore we must convert
   loc.x -= distance * sin(orientation * M_PI / 180);
   loc.y += distance * cos(orientation * M_PI / 180);
+  env->touch();
 }
 
 bool PhysicalObject::updatePosition() {
@@ -262,6 +269,7 @@ void PhysicalObject::setSpeed(int speed) {
   if (speed < 0) {
     throw new invalid_argument("setSpeed: Invalid speed.");
   }
+  env->touch();
 
   this->speed = speed;
 }
@@ -270,6 +278,7 @@ void PhysicalObject::setRadius(int radius) {
   if (radius < 0) {
     throw new invalid_argument("setRadius: Invalid radius.");
   }
+  env->touch();
 
   this->radius = radius;
 }
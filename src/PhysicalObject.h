@@ -230,6 +230,7 @@ public:
 
 protected:
   Environment *const env;
+  RandomStream random; // The object's own stream, from the environment
 
   /**
    * This function finds an open Location to place the object
@@ -0,0 +1,198 @@
+/**
+ * \author Lucas Kramer
+ * \file  PoolFile.cpp
+ * \brief Implementation of the shared optimization pool file
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "PoolFile.h"
+
+const char PoolFile::POOL_MAGIC[4] = {'R', 'R', 'P', 'L'};
+
+PoolFile::PoolFile(const string &filename, unsigned numSlots, unsigned slotSize) :
+  filename(filename), locked(false) {
+  slotStride = (sizeof(Slot) + slotSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  size_t headerSize = (sizeof(Header) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  size = headerSize + numSlots * slotStride;
+
+  fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    cerr << "Could not open pool file " << filename << endl;
+    exit(1);
+  }
+
+  // Only one process may create the file, and the others must wait until it's done
+  lock();
+  struct stat buf;
+  bool created = fstat(fd, &buf) == 0 && buf.st_size == 0;
+  if (created && ftruncate(fd, size) != 0) {
+    cerr << "Could not create pool file " << filename << endl;
+    exit(1);
+  }
+  if (fstat(fd, &buf) != 0 || (size_t)buf.st_size != size) {
+    cerr << "Pool file " << filename << " has the wrong size for " << numSlots <<
+      " slots of " << slotSize << " bytes, clear the pool to change them" << endl;
+    exit(1);
+  }
+  data = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    cerr << "Could not map pool file " << filename << endl;
+    exit(1);
+  }
+
+  // The new file is all zeros, which is an empty slot
+  Header *header = getHeader();
+  if (created) {
+    memcpy(header->magic, POOL_MAGIC, sizeof(header->magic));
+    header->version = POOL_VERSION;
+    header->numSlots = numSlots;
+    header->slotSize = slotSize;
+  }
+  if (memcmp(header->magic, POOL_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != POOL_VERSION) {
+    cerr << "Pool file " << filename << " is not a pool file of version " <<
+      POOL_VERSION << endl;
+    exit(1);
+  }
+  if (header->numSlots != numSlots || header->slotSize != slotSize) {
+    cerr << "Pool file " << filename << " has " << header->numSlots << " slots of " <<
+      header->slotSize << " bytes instead of " << numSlots << " slots of " << slotSize <<
+      " bytes, clear the pool to change them" << endl;
+    exit(1);
+  }
+  unlock();
+}
+
+PoolFile::~PoolFile() {
+  munmap(data, size);
+  close(fd);
+}
+
+unsigned PoolFile::getNumSlots() const {
+  return getHeader()->numSlots;
+}
+
+uint32_t PoolFile::getRevision() const {
+  return getHeader()->revision.load(memory_order_acquire);
+}
+
+uint32_t PoolFile::getSequence(unsigned slot) const {
+  return getSlot(slot)->sequence.load(memory_order_acquire);
+}
+
+uint32_t PoolFile::read(unsigned slotNum, NeuralNetwork *&network, int &performance) {
+  Slot *slot = getSlot(slotNum);
+  const char *slotData = (const char*)(slot + 1);
+  unsigned slotSize = getHeader()->slotSize;
+  vector<char> copy;
+  uint32_t sequence, size;
+
+  // Copy the slot until it wasn't written while copying, then parse the copy
+  while (true) {
+    sequence = slot->sequence.load(memory_order_acquire);
+    if (sequence & 1) {
+      repair(slotNum, sequence);
+      continue;
+    }
+    performance = slot->performance;
+    size = slot->size;
+    if (size <= slotSize)
+      copy.assign(slotData, slotData + size);
+    atomic_thread_fence(memory_order_acquire);
+    if (slot->sequence.load(memory_order_relaxed) == sequence)
+      break;
+  }
+
+  if (size > slotSize) {
+    cerr << "Error when reading pool file " << filename << ": Slot " << slotNum <<
+      " holds " << size << " bytes, more than a slot's " << slotSize << endl;
+    exit(1);
+  }
+  if (size == 0)
+    network = NULL;
+  else
+    network = new NeuralNetwork(NeuralNetwork::fromBinary(copy.data(), size,
+                                                          filename + " slot " + to_string(slotNum)));
+  return sequence;
+}
+
+bool PoolFile::write(unsigned slotNum, const NeuralNetwork &network, int performance) {
+  string binary = network.toBinary();
+  if (binary.size() > getHeader()->slotSize)
+    return false;
+
+  Slot *slot = getSlot(slotNum);
+  beginWrite(slot);
+  slot->performance = performance;
+  slot->size = binary.size();
+  memcpy((char*)(slot + 1), binary.data(), binary.size());
+  endWrite(slot);
+  return true;
+}
+
+void PoolFile::clear(unsigned slotNum) {
+  Slot *slot = getSlot(slotNum);
+  beginWrite(slot);
+  slot->performance = 0;
+  slot->size = 0;
+  endWrite(slot);
+}
+
+void PoolFile::lock() {
+  if (flock(fd, LOCK_EX) != 0) {
+    cerr << "Could not lock pool file " << filename << endl;
+    exit(1);
+  }
+  locked = true;
+}
+
+void PoolFile::unlock() {
+  locked = false;
+  flock(fd, LOCK_UN);
+}
+
+PoolFile::Header *PoolFile::getHeader() const {
+  return (Header*)data;
+}
+
+PoolFile::Slot *PoolFile::getSlot(unsigned slot) const {
+  size_t headerSize = (sizeof(Header) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  return (Slot*)(data + headerSize + slot * slotStride);
+}
+
+void PoolFile::beginWrite(Slot *slot) {
+  slot->sequence.store(slot->sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+void PoolFile::repair(unsigned slotNum, uint32_t sequence) {
+  // Writers hold the lock, so a slot still being written once we have it belongs to a
+  // process that died while writing it
+  Slot *slot = getSlot(slotNum);
+  bool wasLocked = locked;
+  if (!wasLocked)
+    lock();
+  if (slot->sequence.load(memory_order_relaxed) == sequence) {
+    cerr << "Clearing slot " << slotNum << " of pool file " << filename << ", which was left partly written" << endl;
+    slot->performance = 0;
+    slot->size = 0;
+    endWrite(slot);
+  }
+  if (!wasLocked)
+    unlock();
+}
+
+void PoolFile::endWrite(Slot *slot) {
+  slot->sequence.store(slot->sequence.load(memory_order_relaxed) + 1, memory_order_release);
+  getHeader()->revision.fetch_add(1, memory_order_release);
+}
@@ -0,0 +1,158 @@
+#pragma once
+/**
+ * \author Lucas Kramer
+ * \file  PoolFile.h
+ * \brief The optimization pool, stored in a file shared by every optimization process
+ */
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+
+#include "NeuralNetwork.h"
+
+/**
+ * \brief A pool of networks and their performances, stored in a fixed number of slots in
+ * one memory-mapped file
+ * \details Every process optimizing the same pool maps the same file, so an entry written
+ * by one is seen by the others without reloading anything.  Each slot has a sequence
+ * number that is odd while the slot is being written, and that changes with every write,
+ * so readers never need a lock: they copy the slot and check that the sequence number
+ * didn't change meanwhile.  The file also has a revision that changes with every write to
+ * any slot, so checking for updates only reads one number.
+ * Writers must hold the file's lock, which also keeps out writers in other processes, and
+ * threads in the same process must not write at the same time.
+ */
+class PoolFile {
+public:
+  /**
+   * Opens a pool file, creating it with empty slots if it doesn't exist yet.  Exits if
+   * the file was created with a different number of slots or slot size.
+   * \param filename the file
+   * \param numSlots the number of slots
+   * \param slotSize the largest binary network a slot can hold, in bytes
+   */
+  PoolFile(const std::string &filename, unsigned numSlots, unsigned slotSize);
+
+  /**
+   * The PoolFile destructor
+   */
+  ~PoolFile();
+
+  /**
+   * Gets the number of slots in the file
+   * \return the number of slots
+   */
+  unsigned getNumSlots() const;
+
+  /**
+   * Gets the revision of the file, which changes whenever any slot is written
+   * \return the revision
+   */
+  uint32_t getRevision() const;
+
+  /**
+   * Gets the sequence number of a slot, which changes whenever the slot is written
+   * \param slot the slot
+   * \return the sequence number
+   */
+  uint32_t getSequence(unsigned slot) const;
+
+  /**
+   * Reads the entry in a slot, waiting for any write to it to finish.  A slot left partly
+   * written by a process that died is cleared.  
+   * \param slot the slot
+   * \param network set to a new network, or NULL if the slot is empty
+   * \param performance set to the performance of the network
+   * \return the sequence number of the slot that was read
+   */
+  uint32_t read(unsigned slot, NeuralNetwork *&network, int &performance);
+
+  /**
+   * Writes an entry to a slot.  The file must be locked.
+   * \param slot the slot
+   * \param network the network
+   * \param performance the performance of the network
+   * \return false if the network is too large for a slot, in which case the slot is
+   * unchanged
+   */
+  bool write(unsigned slot, const NeuralNetwork &network, int performance);
+
+  /**
+   * Empties a slot.  The file must be locked.
+   * \param slot the slot
+   */
+  void clear(unsigned slot);
+
+  /**
+   * Locks the file for writing, waiting for a writer in another process to finish.  The
+   * lock is released if the process dies, so a crash never leaves the pool locked.
+   */
+  void lock();
+
+  /**
+   * Unlocks the file
+   */
+  void unlock();
+
+private:
+  /** \brief The header at the start of the file */
+  struct Header {
+    char magic[4];                 // POOL_MAGIC
+    uint32_t version;              // POOL_VERSION
+    uint32_t numSlots;
+    uint32_t slotSize;
+    std::atomic<uint32_t> revision;
+  };
+
+  /** \brief The header of a slot, followed by the slot's binary network */
+  struct Slot {
+    std::atomic<uint32_t> sequence; // Odd while being written
+    int32_t performance;
+    uint32_t size;                  // The size of the network, or 0 if the slot is empty
+  };
+
+  static const char POOL_MAGIC[4];
+  static const uint32_t POOL_VERSION = 1;
+  static const size_t ALIGNMENT = 64; // Slots start on their own cache line
+
+  std::string filename;
+  int fd;
+  char *data;
+  size_t size;
+  size_t slotStride;
+  bool locked; // Whether this process holds the lock
+
+  /**
+   * Gets the header of the file
+   * \return the header
+   */
+  Header *getHeader() const;
+
+  /**
+   * Gets the header of a slot, which is followed by its data
+   * \param slot the slot
+   * \return the slot header
+   */
+  Slot *getSlot(unsigned slot) const;
+
+  /**
+   * Helper function for write and clear, marks a slot as being written
+   * \param slot the slot header
+   */
+  void beginWrite(Slot *slot);
+
+  /**
+   * Helper function for read, clears a slot that seems to be being written if its writer
+   * died while writing it
+   * \param slot the slot
+   * \param sequence the odd sequence number the slot was found with
+   */
+  void repair(unsigned slot, uint32_t sequence);
+
+  /**
+   * Helper function for write, clear and repair, marks a slot as written
+   * \param slot the slot header
+   */
+  void endWrite(Slot *slot);
+};
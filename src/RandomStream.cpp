@@ -0,0 +1,47 @@
+/**
+ * \author Lucas Kramer
+ * \file  RandomStream.cpp
+ * \brief Implementation of the Philox4x32-10 random number generator
+ */
+
+#include "RandomStream.h"
+
+// The multipliers and key increments of Philox4x32
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+static const int PHILOX_ROUNDS = 10;
+
+RandomStream::RandomStream(uint64_t seed, uint64_t stream) :
+  used(4) {
+  key[0] = seed;
+  key[1] = seed >> 32;
+  counter[0] = 0;
+  counter[1] = 0;
+  counter[2] = stream;
+  counter[3] = stream >> 32;
+}
+
+void RandomStream::generate() {
+  uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+  uint32_t k0 = key[0], k1 = key[1];
+  for (int i = 0; i < PHILOX_ROUNDS; i++) {
+    uint64_t product0 = (uint64_t)PHILOX_M0 * c0;
+    uint64_t product1 = (uint64_t)PHILOX_M1 * c2;
+    c0 = (uint32_t)(product1 >> 32) ^ c1 ^ k0;
+    c1 = (uint32_t)product1;
+    c2 = (uint32_t)(product0 >> 32) ^ c3 ^ k1;
+    c3 = (uint32_t)product0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  block[0] = c0;
+  block[1] = c1;
+  block[2] = c2;
+  block[3] = c3;
+  used = 0;
+
+  if (++counter[0] == 0)
+    counter[1]++;
+}
@@ -0,0 +1,63 @@
+#pragma once
+/**
+ * \author Lucas Kramer
+ * \file  RandomStream.h
+ * \brief A counter-based random number generator
+ */
+
+#include <stdint.h>
+
+/**
+ * \brief A stream of random numbers from the Philox4x32-10 counter-based generator
+ * \details The numbers are a pure function of the seed, the stream number and the
+ * position in the stream, so any number of independent streams can be made from one seed
+ * without sharing any state.  Every world has a stream, and every object in a world has
+ * its own, so a simulation gives the same results no matter what else is running.
+ */
+class RandomStream {
+public:
+  /**
+   * Constructs a stream
+   * \param seed the seed
+   * \param stream the number of the stream, giving unrelated numbers for each number
+   */
+  RandomStream(uint64_t seed = 0, uint64_t stream = 0);
+
+  /**
+   * Gets the next 32 random bits
+   * \return the bits
+   */
+  uint32_t next() {
+    if (used == 4)
+      generate();
+    return block[used++];
+  }
+
+  /**
+   * Gets a random integer between 0 and bound - 1
+   * \param bound the bound, which must be positive
+   * \return the integer
+   */
+  int nextInt(int bound) {
+    return ((uint64_t)next() * (uint32_t)bound) >> 32;
+  }
+
+  /**
+   * Gets a random float between 0 and 1
+   * \return the float
+   */
+  float nextFloat() {
+    return (next() >> 8) * (1.0f / (1 << 24));
+  }
+
+private:
+  uint32_t key[2];
+  uint32_t counter[4]; // The position in the low half, and the stream in the high half
+  uint32_t block[4];
+  unsigned used;
+
+  /**
+   * Computes the block of numbers at the current position, and moves to the next one
+   */
+  void generate();
+};
@@ -0,0 +1,58 @@
+/**
+ * \author Lucas Kramer
+ * \file   RangeSensor.cpp
+ * \brief  A range finder that measures the distance to obstacles and walls along a ray
+ */
+
+#include "artist.h"
+#include "RangeSensor.h"
+#include "SpatialGrid.h"
+#include "Environment.h"
+#include "configuration.h"
+
+// Needed on some platforms to access the definition of pi, etc.  
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <stdexcept> /* invalid_argument */
+using namespace std;
+
+RangeSensor::RangeSensor(float offset, int orientation,
+                         float maxDistance,
+                         Environment *env) :
+  env(env),
+  offset(offset),
+  orientation(orientation),
+  absoluteOrientation(orientation),
+  maxDistance(maxDistance),
+  latestDistance(maxDistance),
+  latestReading(0) {
+  if (0 > orientation || orientation > 360)
+    throw new invalid_argument("RangeSensor: Angle out of range.");
+  if (maxDistance <= 0)
+    throw new invalid_argument("RangeSensor: Range must be positive.");
+}
+
+int RangeSensor::getOrientation() const {
+  return orientation;
+}
+
+float RangeSensor::getMaxDistance() const {
+  return maxDistance;
+}
+
+void RangeSensor::updatePosition(Location robotLoc, int robotAngle) {
+  absoluteOrientation = (robotAngle + orientation) % 360;
+  absoluteLoc.x = robotLoc.x + offset * sin(absoluteOrientation * M_PI / 180);
+  absoluteLoc.y = robotLoc.y + offset * cos(absoluteOrientation * M_PI / 180);
+}
+
+void RangeSensor::display() {
+  artist::drawRangeSensor(absoluteLoc, absoluteOrientation, latestDistance, latestReading);
+}
+
+float RangeSensor::sense() {
+  latestDistance = env->getObstacleGrid().castRay(absoluteLoc, absoluteOrientation, maxDistance);
+  latestReading = 1 - latestDistance / maxDistance;
+  return latestReading;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file   RangeSensor.h
+ * \brief  A range finder that measures the distance to obstacles and walls along a ray
+ */
+
+#include "Location.h"
+#include "Environment.h"
+#include "configuration.h"
+
+/**
+ * \brief A single beam range finder.  Unlike Sensor it does not sum a field over all
+ * objects, but traces a ray through the environment's obstacle grid and reports how
+ * close the first obstacle or wall is.  
+ */
+class RangeSensor {
+public:
+  /**
+   * RangeSensor constructor
+   * \param offset distance from the center of the robot to the start of the beam
+   * \param orientation orientation of the beam relative to the robot
+   * \param maxDistance the range of the beam
+   */
+  RangeSensor(float offset, int orientation,
+              float maxDistance = GET_FLOAT("RANGE_SENSOR_DISTANCE"),
+              Environment *env = Environment::getEnv());
+
+  /**
+   * Returns the orientation of the beam relative to the robot
+   * \return orientation in degrees
+   */
+  int getOrientation() const;
+
+  /**
+   * Returns the range of the beam
+   * \return the maximum distance in pixels
+   */
+  float getMaxDistance() const;
+
+  /**
+   * Called to update the position of the beam 
+   * match the updated position of the robot 
+   */
+  void updatePosition(Location robotLoc, int robotAngle);
+
+  /**
+   * Displays the beam
+   */
+  void display();
+
+  /**
+   * Traces the beam through the environment
+   * \return 1 - distance / maxDistance, so 0 when nothing is in range and 1 when
+   * touching an obstacle or wall
+   */
+  float sense();
+
+private:
+  Environment *env;
+
+  float offset;
+  int orientation, absoluteOrientation;
+  Location absoluteLoc;
+  float maxDistance;
+  float latestDistance;
+  float latestReading;
+};
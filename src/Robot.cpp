@@ -16,11 +16,31 @@
 #include <math.h>
 
 #include "artist.h"
+#include "sensorkernel.h"
 #include "Environment.h"
 #include "Robot.h"
 #include "configuration.h"
 using namespace std;
 
+namespace {
+  /**
+   * Gets the name of the configuration value describing the sensor layout of a type of
+   * robot
+   */
+  string getSensorArrayConfig(RobotType robotType) {
+    switch (robotType) {
+    case SIMPLE:
+      return "SIMPLE_SENSOR_ARRAY";
+    case COMPLEX:
+      return "COMPLEX_SENSOR_ARRAY";
+    case NEURAL_NETWORK:
+      return "NEURAL_NETWORK_SENSOR_ARRAY";
+    default:
+      throw new invalid_argument("getSensorArrayConfig: Invalid robot type.");
+    }
+  }
+}
+
 Robot::Robot(RobotType robotType,
              int radius,
              Color color,
@@ -38,19 +58,27 @@ Robot::Robot(RobotType robotType,
              Environment *env) :
   PhysicalObject(ROBOT, radius, loc, color, GET_BOOL("ROBOTS_HITABLE"), env),
   robotType(robotType),
-  leftLightSensor (   Location(-GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y")), GET_INT("SENSOR_ANGLE_LEFT"),  LIGHT),
-  rightLightSensor(   Location( GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y")), GET_INT("SENSOR_ANGLE_RIGHT"), LIGHT),
-  leftRobotSensor (   Location(-GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y")), GET_INT("SENSOR_ANGLE_LEFT"),  ROBOT),
-  rightRobotSensor(   Location( GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y")), GET_INT("SENSOR_ANGLE_RIGHT"), ROBOT),
-  leftObstacleSensor (Location(-GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y")), GET_INT("SENSOR_ANGLE_LEFT"),  OBSTACLE),
-  rightObstacleSensor(Location( GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y")), GET_INT("SENSOR_ANGLE_RIGHT"), OBSTACLE),
-  leftTargetSensor (  Location(-GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y")), GET_INT("SENSOR_ANGLE_LEFT"),  targetId != -1? (env->getObject(targetId) != NULL? env->getObject(targetId)->objectType : (ObjectType)-1) : TARGET),
-  rightTargetSensor(  Location( GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y")), GET_INT("SENSOR_ANGLE_RIGHT"), targetId != -1? (env->getObject(targetId) != NULL? env->getObject(targetId)->objectType : (ObjectType)-1) : TARGET),
+  sensors(SensorArray::get(getSensorArrayConfig(robotType))),
   lineColor(lineColor),
   defaultColor(color),
   lastUpdateTime(0),
   pauseTime(0),
-  targetId(targetId) {
+  targetId(targetId),
+  sensorTime(-1),
+  robotSensingTime(-1),
+  inContact(false),
+  contactRevision(-1) {
+  targetType = targetId != -1 && env->getObject(targetId) != NULL? env->getObject(targetId)->objectType : -1;
+
+  // Range sensor beams are spread evenly across RANGE_SENSOR_SPREAD, from left to right
+  int numBeams = GET_INT("RANGE_SENSOR_BEAMS");
+  for (int i = 0; i < numBeams; i++) {
+    int angle = numBeams > 1?
+      -GET_INT("RANGE_SENSOR_SPREAD") / 2 + i * GET_INT("RANGE_SENSOR_SPREAD") / (numBeams - 1) : 0;
+    rangeSensors.push_back(RangeSensor(radius, (angle + 360) % 360, GET_FLOAT("RANGE_SENSOR_DISTANCE"), env));
+  }
+  readings.values.resize(sensors.size(), 0);
+  readings.range.resize(numBeams, 0);
   updateMembers();
   }
 
@@ -66,6 +94,7 @@ void Robot::setTarget(int id) {
   }
 
   targetId = id;
+  targetType = env->getObject(id) != NULL? env->getObject(id)->objectType : -1;
 }
 
 bool Robot::handleCollision(int otherId, bool wasHit) {
@@ -104,22 +133,10 @@ void Robot::update() {
       setColor(GET_COLOR("UPDATE_COLOR"));
   }
   if (GET_BOOL("ENABLE_SENSORS")) {
-    float leftLightSensorVal     = leftLightSensor.sense();
-    float rightLightSensorVal    = rightLightSensor.sense();
-    float leftRobotSensorVal     = leftRobotSensor.sense();
-    float rightRobotSensorVal    = rightRobotSensor.sense();
-    float leftObstacleSensorVal  = leftObstacleSensor.sense();
-    float rightObstacleSensorVal = rightObstacleSensor.sense();
-    float leftTargetSensorVal    = targetId != -1? leftTargetSensor.sense() : 0;
-    float rightTargetSensorVal   = targetId != -1? rightTargetSensor.sense() : 0;
-    float leftSpeed  = getLeftSpeed(leftLightSensorVal, rightLightSensorVal,
-                                    leftRobotSensorVal, rightRobotSensorVal,
-                                    leftObstacleSensorVal, rightObstacleSensorVal,
-                                    leftTargetSensorVal, rightTargetSensorVal);
-    float rightSpeed = getRightSpeed(leftLightSensorVal, rightLightSensorVal,
-                                     leftRobotSensorVal, rightRobotSensorVal,
-                                     leftObstacleSensorVal, rightObstacleSensorVal,
-                                     leftTargetSensorVal, rightTargetSensorVal);
+    readSensors();
+    WheelSpeeds speeds = getWheelSpeeds(readings);
+    float leftSpeed  = speeds.left;
+    float rightSpeed = speeds.right;
     if (pauseTime > 0) {
       setSpeed(0);
       pauseTime--;
@@ -136,15 +153,155 @@ void Robot::update() {
   }
 }
 
+void Robot::readSensors() {
+  if (sensorTime == env->getTime())
+    return;
+
+  // Robots are staggered by id, so sensors that aren't read every step are read by
+  // a different subset of the robots on each step
+  unsigned used = getSensorsUsed();
+  if ((used & sensorBit(ROBOT)) && GET_BOOL("SYMMETRIC_ROBOT_SENSING")) {
+    // The first robot to update in a step reads the robot sensors for everyone
+    if (robotSensingTime != env->getTime())
+      senseRobotsPairwise(env);
+    used &= ~sensorBit(ROBOT);
+  }
+  bool first = readings.time == -1;
+  sensors.sense(env, sensorLoc, sensorOrientation, targetType, readings, getId(), used);
+  if ((used & RANGE_SENSOR_BIT) &&
+      (first || SensorArray::isDue(GET_INT("RANGE_SENSOR_PERIOD"), readings.time, getId()))) {
+    for (unsigned i = 0; i < rangeSensors.size(); i++)
+      readings.range[i] = rangeSensors[i].sense();
+  }
+  sensorTime = env->getTime();
+}
+
 void Robot::updateMembers() {
-  rightLightSensor.updatePosition(getLocation(), getOrientation());
-  leftLightSensor.updatePosition(getLocation(), getOrientation());
-  rightRobotSensor.updatePosition(getLocation(), getOrientation());
-  leftRobotSensor.updatePosition(getLocation(), getOrientation());
-  rightObstacleSensor.updatePosition(getLocation(), getOrientation());
-  leftObstacleSensor.updatePosition(getLocation(), getOrientation());
-  rightTargetSensor.updatePosition(getLocation(), getOrientation());
-  leftTargetSensor.updatePosition(getLocation(), getOrientation());
+  // Sensors read from where the robot was placed by the last call to this, which plain
+  // translation doesn't make
+  sensorLoc = getLocation();
+  sensorOrientation = getOrientation();
+  for (RangeSensor &sensor : rangeSensors)
+    sensor.updatePosition(getLocation(), getOrientation());
+}
+
+const SensorArray &Robot::getSensors() const {
+  return sensors;
+}
+
+const SensorReadings &Robot::getReadings() const {
+  return readings;
+}
+
+bool Robot::isInContact() {
+  if (contactRevision != env->getRevision()) {
+    inContact = env->isCollidingWithHitable(getId());
+    contactRevision = env->getRevision();
+  }
+  return inContact;
+}
+
+unsigned Robot::getSensorsUsed() const {
+  return ALL_SENSORS;
+}
+
+namespace {
+  struct PairwiseSensor {
+    float *reading;
+    Location loc;
+    int orientation;
+    int viewAngle;
+    float strength;
+  };
+
+  /**
+   * Adds the strength of one object to a sensor, given the bearing of the object.
+   * This matches sensorkernel::senseScalar apart from the bearing.  
+   */
+  inline void accumulate(PairwiseSensor &sensor, float x, float y, int absoluteAngle) {
+    int angle = (absoluteAngle + 720 - sensor.orientation) % 360;
+    if (angle > 180)
+      angle -= 360;
+    float angleBrightnessScale = sensorkernel::getFalloff(2 * angle / sensor.viewAngle);
+    float delta_x = x - sensor.loc.x;
+    float delta_y = y - sensor.loc.y;
+    float distanceSquared  = pow(delta_x, 2.0);
+    distanceSquared += pow(delta_y, 2.0);
+    sensor.strength += angleBrightnessScale / distanceSquared;
+  }
+}
+
+void Robot::senseRobotsPairwise(Environment *env) {
+  int time = env->getTime();
+  vector<Robot*> robots;
+  for (PhysicalObject *o : *env) {
+    if (o != NULL && o->objectType == ROBOT) {
+      Robot *robot = (Robot*)o;
+      if (robot->getSensorsUsed() & sensorBit(ROBOT)) {
+        robot->robotSensingTime = time;
+        robots.push_back(robot);
+      }
+    }
+  }
+  if (!SensorArray::isDue(GET_INT("ROBOT_SENSOR_PERIOD"), time, 0))
+    return;
+
+  // Gather the robot sensors of each robot
+  vector<PairwiseSensor> sensors;
+  vector<unsigned> firstSensor;
+  for (Robot *robot : robots) {
+    firstSensor.push_back(sensors.size());
+    const SensorArray &layout = robot->sensors;
+    robot->readings.values.resize(layout.size(), 0);
+    for (unsigned i = 0; i < layout.size(); i++) {
+      if (layout[i].getTypeDetected() == ROBOT) {
+        sensors.push_back({&robot->readings.values[i],
+              layout.getAbsoluteLocation(i, robot->sensorLoc, robot->sensorOrientation),
+              layout.getAbsoluteOrientation(i, robot->sensorOrientation),
+              layout[i].getViewAngle(), 0});
+      }
+    }
+  }
+  firstSensor.push_back(sensors.size());
+
+  int width = env->getWidth();
+  int height = env->getHeight();
+  for (unsigned a = 0; a < robots.size(); a++) {
+    Location locA = robots[a]->getLocation();
+    for (unsigned b = a; b < robots.size(); b++) {
+      Location locB = robots[b]->getLocation();
+      for (int i = -1; i <= 1; i++) {
+        for (int j = -1; j <= 1; j++) {
+          // b as seen by a, and a as seen by b, in the same wrapped copy
+          float bx = i * width + locB.x;
+          float by = j * height + locB.y;
+          float ax = -i * width + locA.x;
+          float ay = -j * height + locA.y;
+          double bearing = atan2(bx - locA.x, by - locA.y) * 180 / M_PI;
+          int bearingAB = (int)bearing;
+          int bearingBA = (int)(bearing > 0? bearing - 180 : bearing + 180);
+
+          if (b == a) {
+            // A robot is too close to its own sensors to share a bearing between them
+            for (unsigned s = firstSensor[a]; s < firstSensor[a + 1]; s++)
+              accumulate(sensors[s], bx, by,
+                         (int)(atan2(bx - sensors[s].loc.x, by - sensors[s].loc.y) * 180 / M_PI));
+          }
+          else {
+            for (unsigned s = firstSensor[a]; s < firstSensor[a + 1]; s++)
+              accumulate(sensors[s], bx, by, bearingAB);
+            for (unsigned s = firstSensor[b]; s < firstSensor[b + 1]; s++)
+              accumulate(sensors[s], ax, ay, bearingBA);
+          }
+        }
+      }
+    }
+  }
+
+  for (PairwiseSensor &sensor : sensors) {
+    float strength = sensor.strength * GET_FLOAT("SENSOR_SCALE");
+    *sensor.reading = strength > 1? 1 : strength;
+  }
 }
 
 float Robot::getNewSpeed(float leftSpeed, float rightSpeed) {
@@ -184,25 +341,25 @@ void Robot::display() {
   artist::drawRobot(getLocation(), getRadius(), getOrientation(), getColor(), getLineColor());
   switch (GET_INT("DISPLAY_SENSOR")) {
   case 1:
-    leftLightSensor.display();
-    rightLightSensor.display();
+    sensors.display(sensorLoc, sensorOrientation, LIGHT, readings);
     break;
   case 2:
-    leftRobotSensor.display();
-    rightRobotSensor.display();
+    sensors.display(sensorLoc, sensorOrientation, ROBOT, readings);
     break;
   case 3:
-    leftObstacleSensor.display();
-    rightObstacleSensor.display();
+    sensors.display(sensorLoc, sensorOrientation, OBSTACLE, readings);
     break;
   case 4:
-    leftTargetSensor.display();
-    rightTargetSensor.display();
+    sensors.display(sensorLoc, sensorOrientation, TARGET, readings);
+    break;
+  case 5:
+    for (RangeSensor &sensor : rangeSensors)
+      sensor.display();
     break;
   }
 
   // Have to set the color after calling display, or it gets reset immediatly.
-  if (env->isCollidingWithHitable(getId())) {
+  if (isInContact()) {
     if (getColor() != GET_COLOR("COLLISION_COLOR") &&
         getColor() != GET_COLOR("UPDATE_COLOR"))
       defaultColor = getColor();
@@ -8,11 +8,19 @@
  */
 
 #include "PhysicalObject.h"
-#include "Sensor.h"
+#include "SensorArray.h"
+#include "RangeSensor.h"
 #include "configuration.h"
 
+#include <vector>
+
 enum RobotType {SIMPLE, COMPLEX, NEURAL_NETWORK};
 
+/** \brief The wheel speeds chosen by a robot's controller */
+struct WheelSpeeds {
+  float left, right;
+};
+
 /** \brief Robot that moves around the window and bumps into obstacles */
 class Robot : public PhysicalObject {
 public:
@@ -88,24 +96,76 @@ public:
   void setLineColor(Color lineColor);
   Color getLineColor();
 
+  /**
+   * \author Lucas Kramer
+   * Gets the layout of the sensors, shared by all robots of the same type
+   * \return the layout
+   */
+  const SensorArray &getSensors() const;
+
+  /**
+   * \author Lucas Kramer
+   * Gets the readings of the sensors from the robot's last update
+   * \return the readings
+   */
+  const SensorReadings &getReadings() const;
+
+  /**
+   * \author Lucas Kramer
+   * Checks if the robot is touching a wall or a hitable object.  The result is cached
+   * until the environment revision changes.  
+   * \return true if the robot is in contact
+   */
+  bool isInContact();
+
 protected:
-  virtual float getLeftSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                             float leftRobotSensorVal, float rightRobotSensorVal,
-                             float leftObstacleSensorVal, float rightObstacleSensorVal,
-                             float leftTargetSensorVal, float rightTargetSensorVal) = 0;
-  virtual float getRightSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                              float leftRobotSensorVal, float rightRobotSensorVal,
-                              float leftObstacleSensorVal, float rightObstacleSensorVal,
-                              float leftTargetSensorVal, float rightTargetSensorVal) = 0;
+  /**
+   * \author Lucas Kramer
+   * Gets the types of sensors read by the controller, as a mask built with sensorBit
+   * and RANGE_SENSOR_BIT.  Sensors of other types are never read and stay 0.  
+   * \return the mask, ALL_SENSORS unless overridden
+   */
+  virtual unsigned getSensorsUsed() const;
+
+  /**
+   * \author Lucas Kramer
+   * Runs the controller on the sensor readings, once per update
+   * \param readings the readings from the robot's sensors
+   * \return the speeds of the left and right wheels
+   */
+  virtual WheelSpeeds getWheelSpeeds(const SensorReadings &readings) = 0;
+
+  /**
+   * \author Lucas Kramer
+   * Reads the sensors used by the controller into the robot's readings.  This is done
+   * by update, and does nothing if the sensors were already read in this step.  
+   */
+  void readSensors();
 
 private:
-  Sensor leftLightSensor, rightLightSensor;
-  Sensor leftRobotSensor, rightRobotSensor;
-  Sensor leftObstacleSensor, rightObstacleSensor;
-  Sensor leftTargetSensor, rightTargetSensor;
+  const SensorArray &sensors;
+  SensorReadings readings;
+  Location sensorLoc;
+  int sensorOrientation;
+  int targetType;
+  std::vector<RangeSensor> rangeSensors;
   Color lineColor, defaultColor;
   int lastUpdateTime, pauseTime;
   int targetId;
+  int sensorTime;
+  int robotSensingTime;
+  bool inContact;
+  int contactRevision;
+
+  /**
+   * Reads the robot sensors of every robot in the environment by visiting each pair of
+   * robots once.  The bearing between a pair is computed once from the displacement
+   * between their centers and used for both robots' sensors, while the distances are
+   * still measured from each sensor.  Only robots that use their robot sensors are
+   * included.  
+   * \param env the environment
+   */
+  static void senseRobotsPairwise(Environment *env);
 
   /**
    * This function computes the combined speed from the wheel speeds
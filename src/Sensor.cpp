@@ -7,6 +7,7 @@
  */
 
 #include "artist.h"
+#include "sensorkernel.h"
 #include "Sensor.h"
 #include "Environment.h"
 #include "configuration.h"
@@ -20,18 +21,16 @@ using namespace std;
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include <vector>
 #include <stdexcept> /* invalid_argument */
 using std::invalid_argument;
 
 Sensor::Sensor(Location loc, int orientation,
-               ObjectType typeDetected,
-               Environment *env) :
-  Sensor(loc, orientation, GET_INT("SENSOR_VIEWANGLE"), typeDetected, env) {}
+               ObjectType typeDetected) :
+  Sensor(loc, orientation, GET_INT("SENSOR_VIEWANGLE"), typeDetected) {}
 
 Sensor::Sensor(Location loc, int orientation, int viewAngle,
-               ObjectType typeDetected,
-               Environment *env) :
-  env(env),
+               ObjectType typeDetected) :
   typeDetected(typeDetected) {
   setPosition(loc);
   setOrientation(orientation);
@@ -47,15 +46,15 @@ void Sensor::setPosition(float x, float y) {
   loc.y = y;
 }
 
-Location Sensor::getPosition() {
+Location Sensor::getPosition() const {
   return loc;
 }
 
-float Sensor::getXPosition() {
+float Sensor::getXPosition() const {
   return loc.x;
 }
 
-float Sensor::getYPosition() {
+float Sensor::getYPosition() const {
   return loc.y;
 }
 
@@ -67,7 +66,7 @@ void Sensor::setOrientation(int orientation) {
   this->orientation = orientation;
 }
 
-int Sensor::getOrientation() {
+int Sensor::getOrientation() const {
   return orientation;
 }
 
@@ -78,7 +77,7 @@ void Sensor::setViewAngle(int degrees) {
   viewAngle = degrees;
 }
 
-int Sensor::getViewAngle() {
+int Sensor::getViewAngle() const {
   return viewAngle;
 }
 
@@ -86,29 +85,60 @@ void Sensor::setTypeDetected(ObjectType type) {
   typeDetected = type;
 }
 
-ObjectType Sensor::getTypeDetected() {
+ObjectType Sensor::getTypeDetected() const {
   return typeDetected;
 }
 
-void Sensor::display() {
-  artist::drawSensor(absoluteLoc, absoluteOrientation, getViewAngle(), latestReading);
+void Sensor::display(Location absoluteLoc, int absoluteOrientation, float reading) const {
+  artist::drawSensor(absoluteLoc, absoluteOrientation, getViewAngle(), reading);
 }
 
-void Sensor::updatePosition(Location robotLoc, int robotAngle) {
-  float cos_v = cos(robotAngle * M_PI / 180);
-  float sin_v = sin(robotAngle * M_PI / 180);
-  absoluteOrientation = (robotAngle + orientation) % 360;
-  absoluteLoc.x = robotLoc.x + cos_v * loc.x + sin_v * loc.y;
-  absoluteLoc.y = robotLoc.y - sin_v * loc.x + cos_v * loc.y; 
+float Sensor::sense(Environment *env, Location absoluteLoc, int absoluteOrientation,
+                    int type) const {
+  float strength;
+  if (GET_BOOL("VECTORIZE_SENSORS")) {
+    const Environment::PackedObjects &objects = env->getPackedObjects(type);
+    strength = sensorkernel::sense(objects.x.data(), objects.y.data(), objects.x.size(),
+                                   absoluteLoc, absoluteOrientation, getViewAngle());
+    if (GET_BOOL("VALIDATE_SENSOR_KERNEL"))
+      validateKernel(env, absoluteLoc, absoluteOrientation, type, objects, strength);
+  }
+  else {
+    strength = senseObjects(env, absoluteLoc, absoluteOrientation, type);
+  }
+  
+  strength *= GET_FLOAT("SENSOR_SCALE");
+  if (strength > 1)
+    strength = 1;
+
+  return strength;
 }
 
-float Sensor::sense() {
+void Sensor::validateKernel(Environment *env, Location absoluteLoc, int absoluteOrientation,
+                            int type, const Environment::PackedObjects &objects,
+                            float strength) const {
+  // The reading is checked against the objects where they are now, so a stale packed
+  // position shows up as a mismatch too
+  float reference = senseObjects(env, absoluteLoc, absoluteOrientation, type);
+  float scalar = sensorkernel::senseScalar(objects.x.data(), objects.y.data(),
+                                           objects.x.size(), absoluteLoc,
+                                           absoluteOrientation, getViewAngle());
+  if (scalar != reference || fabs(strength - reference) > 1e-4 * fabs(reference)) {
+    cerr << "Sensor kernel mismatch at (" << absoluteLoc.x << ", " << absoluteLoc.y
+         << "), orientation " << absoluteOrientation << ": reference " << reference
+         << ", scalar " << scalar << ", " << sensorkernel::getKernelName() << " "
+         << strength << endl;
+  }
+}
+
+float Sensor::senseObjects(Environment *env, Location absoluteLoc, int absoluteOrientation,
+                           int type) const {
   float distanceSquared, delta_x, delta_y;
   int absoluteAngleToLight, angle;
 
   float strength = 0.0;
   for (PhysicalObject *o : *Environment::getEnv()) {
-    if (o != NULL && o->objectType == typeDetected) {
+    if (o != NULL && o->objectType == type) {
       struct {int x; int y;} offsets[] =
                               {{-env->getWidth(), -env->getHeight()},
                                {-env->getWidth(), 0},
@@ -190,12 +220,6 @@ float Sensor::sense() {
   }
 */
   
-  strength *= GET_FLOAT("SENSOR_SCALE");
-  if (strength > 1)
-    strength = 1;
-
-  //artist::drawSensor(absoluteLoc, absoluteOrientation, getViewAngle(), strength);
-  latestReading = strength;
   return strength;
 }
 
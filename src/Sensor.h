@@ -13,6 +13,11 @@
 #include "configuration.h"
 #include "PhysicalObject.h"
 
+/**
+ * \brief One sensor in a SensorArray.  The sensor only describes where it sits on the
+ * robot and what it detects; the robot supplies its absolute position when sensing, so
+ * one sensor can be shared by every robot with the same layout.  
+ */
 class Sensor {
 public:
   /**
@@ -22,8 +27,7 @@ public:
    * \param typeDetected type that sensor will detect
    */
   Sensor(Location loc, int orientation,
-         ObjectType typeDetected,
-         Environment *env = Environment::getEnv());
+         ObjectType typeDetected);
   
   /**
    * Sensor constructor
@@ -33,8 +37,7 @@ public:
    * \param typeDetected type that sensor will detect
    */
   Sensor(Location loc, int orientation, int viewAngle,
-         ObjectType typeDetected,
-         Environment *env = Environment::getEnv());
+         ObjectType typeDetected);
 
   //Location of sensor is relitive to robot sensor.
     
@@ -55,19 +58,19 @@ public:
    * Returns a Location struct of x and y position in pixels of the sensor
    * \return A Location struct of x and y position
    */
-  Location getPosition();
+  Location getPosition() const;
   
   /**
    * Returns the x position in pixels of the sensor
    * \return x position
    */
-  float getXPosition();
+  float getXPosition() const;
   
   /**
    * Returns the y position in pixels of the sensor
    * \return y position
    */
-  float getYPosition();
+  float getYPosition() const;
   
   /**
    * Sets the orientation for the sensor
@@ -79,7 +82,7 @@ public:
    * Returns the orientation of the sensor
    * \return orientation in degrees
    */
-  int getOrientation();
+  int getOrientation() const;
   
   /**
    * Sets the view angle of the sensor
@@ -91,7 +94,7 @@ public:
    * Returns the view angle of the sensor
    * \return view angle in degrees
    */
-  int getViewAngle();
+  int getViewAngle() const;
 
   /**
    * Sets the object type that the sensor detects
@@ -101,38 +104,55 @@ public:
   void setTypeDetected(ObjectType type);
   
   /**
-   * Returns the type that sensor detects
+   * Returns the type that sensor detects.  TARGET means the target of the robot.  
    * \author Himawan
    * \return type the sensor detects
    */
-  ObjectType getTypeDetected();
-
-  /**
-   * Called to update the position of the sensor 
-   * match the updated position of the robot 
-   * \author Carl
-   */
-  void updatePosition(Location robotLoc, int robotAngle);
+  ObjectType getTypeDetected() const;
 
   /**
    * Displays the sensor 
    * \author Carl
+   * \param absoluteLoc the absolute location of the sensor
+   * \param absoluteOrientation the absolute orientation of the sensor
+   * \param reading the latest reading of the sensor
    */
-  void display();
+  void display(Location absoluteLoc, int absoluteOrientation, float reading) const;
   
   /**
    * Returns some strength by sensing the environment
    * \author Carl & Himawan
+   * \param env the environment to sense
+   * \param absoluteLoc the absolute location of the sensor
+   * \param absoluteOrientation the absolute orientation of the sensor
+   * \param type the type of the objects to detect, which differs from
+   * getTypeDetected() for target sensors
    * \return the strength of sensor reading of [0..1]
    */
-  float sense();
+  float sense(Environment *env, Location absoluteLoc, int absoluteOrientation,
+              int type) const;
 
 private:
-  Environment *env;
-
-  Location loc, absoluteLoc;
-  int orientation, absoluteOrientation;
+  Location loc;
+  int orientation;
   int viewAngle;
   ObjectType typeDetected;
-  float latestReading;
+
+  /**
+   * Sums the strength from every object in the environment one at a time.  This is
+   * the reference implementation that the packed sensor kernels are checked against.  
+   * \return the raw strength, before scaling
+   */
+  float senseObjects(Environment *env, Location absoluteLoc, int absoluteOrientation,
+                     int type) const;
+
+  /**
+   * Compares a reading from the packed positions, and the scalar kernel on the same
+   * packed positions, against senseObjects, and reports any mismatch
+   * \param objects the packed positions the reading was taken from
+   * \param strength the raw strength that was read
+   */
+  void validateKernel(Environment *env, Location absoluteLoc, int absoluteOrientation,
+                      int type, const Environment::PackedObjects &objects,
+                      float strength) const;
 };
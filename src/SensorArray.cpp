@@ -0,0 +1,166 @@
+/**
+ * \author Lucas Kramer
+ * \file   SensorArray.cpp
+ * \brief  The layout of the sensors on a kind of robot, and the readings taken from it
+ */
+
+#include "SensorArray.h"
+#include "Environment.h"
+#include "configuration.h"
+
+#include <sstream>
+#include <unordered_map>
+#include <mutex>
+#include <stdexcept>
+// Needed on some platforms to access the definition of pi, etc.  
+#define _USE_MATH_DEFINES
+#include <math.h>
+using namespace std;
+
+float SensorReadings::get(ObjectType type, unsigned n) const {
+  int index = layout->find(type, n);
+  return index != -1? values[index] : 0;
+}
+
+SensorArray::SensorArray() {
+  Location left(-GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y"));
+  Location right(GET_FLOAT("SENSOR_POSITION_X"), GET_FLOAT("SENSOR_POSITION_Y"));
+  for (ObjectType type : {LIGHT, ROBOT, OBSTACLE, TARGET}) {
+    sensors.push_back(Sensor(left, GET_INT("SENSOR_ANGLE_LEFT"), type));
+    sensors.push_back(Sensor(right, GET_INT("SENSOR_ANGLE_RIGHT"), type));
+  }
+}
+
+SensorArray::SensorArray(const string &description) {
+  istringstream list(description);
+  string item;
+  while (getline(list, item, ';')) {
+    istringstream fields(item);
+    string typeName;
+    float x, y;
+    int orientation, viewAngle;
+    if (!(fields >> typeName))
+      continue; // Allow empty items, such as after a trailing ;
+    if (!(fields >> x >> y >> orientation))
+      throw new invalid_argument("SensorArray: Expected type x y orientation in \"" + item + "\"");
+    if (!(fields >> viewAngle))
+      viewAngle = GET_INT("SENSOR_VIEWANGLE");
+
+    ObjectType type;
+    if (typeName == "light")
+      type = LIGHT;
+    else if (typeName == "robot")
+      type = ROBOT;
+    else if (typeName == "obstacle")
+      type = OBSTACLE;
+    else if (typeName == "target")
+      type = TARGET;
+    else
+      throw new invalid_argument("SensorArray: Unknown sensor type " + typeName);
+
+    sensors.push_back(Sensor(Location(x, y), orientation, viewAngle, type));
+  }
+}
+
+const SensorArray &SensorArray::get(const string &configName) {
+  static unordered_map<string, SensorArray*> layouts;
+  static mutex layoutsMutex;
+
+  lock_guard<mutex> lock(layoutsMutex);
+  SensorArray *&layout = layouts[configName];
+  if (layout == NULL) {
+    if (DEFINED(configName) && GET_STRING(configName) != "")
+      layout = new SensorArray(GET_STRING(configName));
+    else
+      layout = new SensorArray();
+  }
+  return *layout;
+}
+
+unsigned SensorArray::size() const {
+  return sensors.size();
+}
+
+const Sensor &SensorArray::operator[](unsigned i) const {
+  return sensors[i];
+}
+
+int SensorArray::find(ObjectType type, unsigned n) const {
+  for (unsigned i = 0; i < sensors.size(); i++) {
+    if (sensors[i].getTypeDetected() == type) {
+      if (n == 0)
+        return i;
+      n--;
+    }
+  }
+  return -1;
+}
+
+Location SensorArray::getAbsoluteLocation(const Sensor &sensor, Location robotLoc,
+                                          float cos_v, float sin_v) {
+  Location loc = sensor.getPosition();
+  return Location(robotLoc.x + cos_v * loc.x + sin_v * loc.y,
+                  robotLoc.y - sin_v * loc.x + cos_v * loc.y);
+}
+
+bool SensorArray::isDue(int period, int time, int phase) {
+  return period <= 1 || (time + phase) % period == 0;
+}
+
+Location SensorArray::getAbsoluteLocation(unsigned i, Location robotLoc, int robotAngle) const {
+  return getAbsoluteLocation(sensors[i], robotLoc,
+                             cos(robotAngle * M_PI / 180), sin(robotAngle * M_PI / 180));
+}
+
+int SensorArray::getAbsoluteOrientation(unsigned i, int robotAngle) const {
+  return (robotAngle + sensors[i].getOrientation()) % 360;
+}
+
+void SensorArray::sense(Environment *env, Location robotLoc, int robotAngle, int targetType,
+                        SensorReadings &readings, int phase, unsigned used) const {
+  bool first = readings.time == -1 || readings.layout != this;
+  int time = env->getTime();
+  bool due[LAST + 1];
+  due[LIGHT]    = (used & sensorBit(LIGHT)) &&
+    (first || isDue(GET_INT("LIGHT_SENSOR_PERIOD"), time, phase));
+  due[ROBOT]    = (used & sensorBit(ROBOT)) &&
+    (first || isDue(GET_INT("ROBOT_SENSOR_PERIOD"), time, phase));
+  due[OBSTACLE] = (used & sensorBit(OBSTACLE)) &&
+    (first || isDue(GET_INT("OBSTACLE_SENSOR_PERIOD"), time, phase));
+  due[TARGET]   = (used & sensorBit(TARGET)) &&
+    (first || isDue(GET_INT("TARGET_SENSOR_PERIOD"), time, phase));
+
+  float cos_v = cos(robotAngle * M_PI / 180);
+  float sin_v = sin(robotAngle * M_PI / 180);
+  readings.layout = this;
+  readings.time = time;
+  readings.values.resize(sensors.size());
+  for (unsigned i = 0; i < sensors.size(); i++) {
+    const Sensor &sensor = sensors[i];
+    int type = sensor.getTypeDetected();
+    if (!due[type])
+      continue;
+    if (type == TARGET) {
+      if (targetType == -1) {
+        readings.values[i] = 0;
+        continue;
+      }
+      type = targetType;
+    }
+    readings.values[i] =
+      sensor.sense(env, getAbsoluteLocation(sensor, robotLoc, cos_v, sin_v),
+                   (robotAngle + sensor.getOrientation()) % 360, type);
+  }
+}
+
+void SensorArray::display(Location robotLoc, int robotAngle, ObjectType type,
+                          const SensorReadings &readings) const {
+  float cos_v = cos(robotAngle * M_PI / 180);
+  float sin_v = sin(robotAngle * M_PI / 180);
+  for (unsigned i = 0; i < sensors.size() && i < readings.values.size(); i++) {
+    if (sensors[i].getTypeDetected() == type)
+      sensors[i].display(getAbsoluteLocation(sensors[i], robotLoc, cos_v, sin_v),
+                         (robotAngle + sensors[i].getOrientation()) % 360,
+                         readings.values[i]);
+  }
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file   SensorArray.h
+ * \brief  The layout of the sensors on a kind of robot, and the readings taken from it
+ */
+
+#include "Sensor.h"
+#include "Location.h"
+#include "configuration.h"
+
+#include <string>
+#include <vector>
+
+class SensorArray;
+
+/**
+ * \brief Gets the bit for a type of sensor in a mask of the sensors used by a controller
+ * \param type the type detected by the sensors
+ * \return the bit
+ */
+inline unsigned sensorBit(ObjectType type) {return 1 << type;}
+
+/** \brief The bit for the range sensors in a mask of the sensors used by a controller */
+const unsigned RANGE_SENSOR_BIT = 1 << (LAST + 1);
+
+/** \brief A mask of the sensors used by a controller that includes every sensor */
+const unsigned ALL_SENSORS = ~0u;
+
+/**
+ * \brief The readings from one pass over a robot's SensorArray, passed to the robot's
+ * controller
+ */
+struct SensorReadings {
+  SensorReadings() : layout(NULL), time(-1) {}
+
+  /** The layout the readings were taken from */
+  const SensorArray *layout;
+
+  /** One reading per sensor in the layout, in layout order */
+  std::vector<float> values;
+
+  /** The range sensor readings, from left to right */
+  std::vector<float> range;
+
+  /** The environment step of the last pass, or -1 before the first */
+  int time;
+
+  /**
+   * Gets the reading of the nth sensor in the layout that detects a type
+   * \param type the type detected, where TARGET means the robot's target
+   * \param n which of the sensors of that type, in layout order
+   * \return the reading, or 0 if the layout has no such sensor
+   */
+  float get(ObjectType type, unsigned n = 0) const;
+};
+
+/**
+ * \brief The sensors on a kind of robot.  A layout is shared by every robot of that kind,
+ * which only keeps its own readings.  
+ * \details A layout is described in the configuration as a list of sensors separated by
+ * semicolons, each of the form "type x y orientation [viewAngle]", where type is one of
+ * light, robot, obstacle or target.  An empty description gives the default pair of
+ * left and right sensors for each type.  
+ */
+class SensorArray {
+public:
+  /**
+   * \brief Constructs the default layout, a left and right sensor for each type
+   * placed according to SENSOR_POSITION_X, SENSOR_POSITION_Y, SENSOR_ANGLE_LEFT and
+   * SENSOR_ANGLE_RIGHT
+   */
+  SensorArray();
+
+  /**
+   * \brief Constructs a layout from a description.  Throws an exception if the
+   * description is invalid
+   * \param description the description
+   */
+  SensorArray(const std::string &description);
+
+  /**
+   * Gets the layout for a kind of robot, described by a configuration value.  Layouts
+   * are parsed once and shared from then on.  
+   * \param configName the name of the configuration value describing the layout
+   * \return the layout
+   */
+  static const SensorArray &get(const std::string &configName);
+
+  /**
+   * \return the number of sensors
+   */
+  unsigned size() const;
+
+  /**
+   * \param i the index of the sensor
+   * \return the sensor
+   */
+  const Sensor &operator[](unsigned i) const;
+
+  /**
+   * Finds the nth sensor of a type
+   * \param type the type detected
+   * \param n which of the sensors of that type, in layout order
+   * \return the index of the sensor, or -1 if there is no such sensor
+   */
+  int find(ObjectType type, unsigned n = 0) const;
+
+  /**
+   * Computes the absolute position of a sensor on a robot
+   * \param i the index of the sensor
+   * \param robotLoc the location of the robot
+   * \param robotAngle the orientation of the robot
+   * \return the absolute location
+   */
+  Location getAbsoluteLocation(unsigned i, Location robotLoc, int robotAngle) const;
+
+  /**
+   * Computes the absolute orientation of a sensor on a robot
+   * \param i the index of the sensor
+   * \param robotAngle the orientation of the robot
+   * \return the absolute orientation
+   */
+  int getAbsoluteOrientation(unsigned i, int robotAngle) const;
+
+  /**
+   * Reads the sensors in one pass.  Each type of sensor is only read every
+   * LIGHT_SENSOR_PERIOD, ROBOT_SENSOR_PERIOD, OBSTACLE_SENSOR_PERIOD or
+   * TARGET_SENSOR_PERIOD steps, keeping its last reading in between, except on the
+   * first pass when every sensor is read.  
+   * \param env the environment to sense
+   * \param robotLoc the location of the robot
+   * \param robotAngle the orientation of the robot
+   * \param targetType the object type of the robot's target, or -1 if it has none.
+   * Target sensors read 0 without a target.  
+   * \param readings the readings to fill in
+   * \param phase offsets the steps on which sensors are read, so that robots with
+   * different phases spread their reads over different steps
+   * \param used a mask of the types of sensors to read, built with sensorBit.  The
+   * other sensors are skipped and read 0.  
+   */
+  void sense(Environment *env, Location robotLoc, int robotAngle, int targetType,
+             SensorReadings &readings, int phase = 0, unsigned used = ALL_SENSORS) const;
+
+  /**
+   * Checks if a sensor with the given period is due to be read
+   * \param period the number of steps between reads
+   * \param time the current step
+   * \param phase the offset of the steps on which it is read
+   * \return true if it should be read on this step
+   */
+  static bool isDue(int period, int time, int phase);
+
+  /**
+   * Displays every sensor detecting a type
+   * \param robotLoc the location of the robot
+   * \param robotAngle the orientation of the robot
+   * \param type the type of the sensors to display
+   * \param readings the latest readings
+   */
+  void display(Location robotLoc, int robotAngle, ObjectType type,
+               const SensorReadings &readings) const;
+
+private:
+  std::vector<Sensor> sensors;
+
+  /**
+   * Computes the absolute position of a sensor
+   * \param sensor the sensor
+   * \param robotLoc the location of the robot
+   * \param cos_v the cosine of the robot orientation
+   * \param sin_v the sine of the robot orientation
+   * \return the absolute location
+   */
+  static Location getAbsoluteLocation(const Sensor &sensor, Location robotLoc,
+                                      float cos_v, float sin_v);
+};
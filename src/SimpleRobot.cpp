@@ -37,16 +37,15 @@ SimpleRobot::SimpleRobot(int radius,
 
 SimpleRobot::~SimpleRobot() {}
 
-float SimpleRobot::getLeftSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                                float leftRobotSensorVal, float rightRobotSensorVal,
-                                float leftObstacleSensorVal, float rightObstacleSensorVal,
-                                float leftTargetSensorVal, float rightTargetSensorVal) {
-  return rightTargetSensorVal * GET_FLOAT("SPEED_SCALE_FACTOR") + GET_INT("ROBOT_INITIAL_SPEED");
+unsigned SimpleRobot::getSensorsUsed() const {
+  return sensorBit(TARGET);
 }
 
-float SimpleRobot::getRightSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                                 float leftRobotSensorVal, float rightRobotSensorVal,
-                                 float leftObstacleSensorVal, float rightObstacleSensorVal,
-                                 float leftTargetSensorVal, float rightTargetSensorVal) {
-  return leftTargetSensorVal * GET_FLOAT("SPEED_SCALE_FACTOR") + GET_INT("ROBOT_INITIAL_SPEED");
+WheelSpeeds SimpleRobot::getWheelSpeeds(const SensorReadings &readings) {
+  float scale = GET_FLOAT("SPEED_SCALE_FACTOR");
+  int initialSpeed = GET_INT("ROBOT_INITIAL_SPEED");
+  WheelSpeeds speeds;
+  speeds.left  = readings.get(TARGET, 1) * scale + initialSpeed;
+  speeds.right = readings.get(TARGET, 0) * scale + initialSpeed;
+  return speeds;
 }
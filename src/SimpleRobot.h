@@ -7,7 +7,7 @@
 
 #include "PhysicalObject.h"
 #include "Robot.h"
-#include "Sensor.h"
+#include "SensorArray.h"
 #include "configuration.h"
 
 /** \brief A simple robot with uncrossed feedback. */
@@ -28,13 +28,7 @@ public:
 
   ~SimpleRobot();
 
-  float getLeftSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                     float leftRobotSensorVal, float rightRobotSensorVal,
-                     float leftObstacleSensorVal, float rightObstacleSensorVal,
-                     float leftTargetSensorVal, float rightTargetSensorVal);
-  float getRightSpeed(float leftLightSensorVal, float rightLightSensorVal,
-                      float leftRobotSensorVal, float rightRobotSensorVal,
-                      float leftObstacleSensorVal, float rightObstacleSensorVal,
-                      float leftTargetSensorVal, float rightTargetSensorVal);
+  unsigned getSensorsUsed() const;
+  WheelSpeeds getWheelSpeeds(const SensorReadings &readings);
 };
 
@@ -44,7 +44,10 @@ Simulation::Simulation(int argc, char* argv[]) :
   simulationFile(NULL),
   openedFile(false),
   mouseDownLoc(Location(-1, -1)),
-  mouseDownId(-1) {
+  mouseDownId(-1),
+  statsEnv(-1),
+  statsId(-1),
+  statsRevision(-1) {
   
   setCaption("Robot Simulation");
 
@@ -127,6 +130,9 @@ Simulation::Simulation(int argc, char* argv[]) :
   m_glui->add_column_to_panel(statsBox, false);
   orientationText = new GLUI_StaticText(statsBox, statInitText.c_str());
   speedText = new GLUI_StaticText(statsBox, statInitText.c_str());
+  m_glui->add_column_to_panel(statsBox, false);
+  sensorsText = new GLUI_StaticText(statsBox, statInitText.c_str());
+  contactText = new GLUI_StaticText(statsBox, statInitText.c_str());
   string messageInitText(GET_INT("MAX_MESSAGE_LENGTH"), ' ');
   messageBox = new GLUI_Rollout(m_glui, "Messages");
   settings.push_back(messageBox);
@@ -867,6 +873,15 @@ string ftos(float f) {
 }
 
 void Simulation::showStats() {
+  // Nothing shown can have changed unless the selection or the revision changed
+  Environment *env = Environment::getEnv();
+  if ((int)env->getSerial() == statsEnv && mouseDownId == statsId &&
+      env->getRevision() == statsRevision)
+    return;
+  statsEnv = env->getSerial();
+  statsId = mouseDownId;
+  statsRevision = env->getRevision();
+
   if (mouseDownId != -1 && getObject(mouseDownId) != NULL) {
     PhysicalObject *o = getObject(mouseDownId);
     radiusText->set_text((     "Radius:    " + to_string(o->getRadius())).c_str());
@@ -878,6 +893,22 @@ void Simulation::showStats() {
     orientationText->update_size();
     speedText->set_text((      "Speed:       " + to_string(o->getSpeed())).c_str());
     speedText->update_size();
+    if (o->objectType == ROBOT) {
+      Robot *robot = (Robot*)o;
+      ostringstream sensors;
+      sensors << "Sensors:";
+      sensors.precision(2);
+      for (float reading : robot->getReadings().values)
+        sensors << " " << reading;
+      sensorsText->set_text(sensors.str().substr(0, GET_INT("MAX_STAT_LENGTH")).c_str());
+      contactText->set_text(robot->isInContact()? "Contact: yes" : "Contact: no");
+    }
+    else {
+      sensorsText->set_text("");
+      contactText->set_text("");
+    }
+    sensorsText->update_size();
+    contactText->update_size();
   }
   else {
     string statInitText(GET_INT("MAX_STAT_LENGTH"), ' ');
@@ -885,6 +916,8 @@ void Simulation::showStats() {
     LocationText->set_text(statInitText.c_str());
     orientationText->set_text(statInitText.c_str());
     speedText->set_text(statInitText.c_str());
+    sensorsText->set_text(statInitText.c_str());
+    contactText->set_text(statInitText.c_str());
   }
 }
 
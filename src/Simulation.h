@@ -255,9 +255,17 @@ private:
   GLUI_StaticText *LocationText;
   GLUI_StaticText *orientationText;
   GLUI_StaticText *speedText;
+  GLUI_StaticText *sensorsText;
+  GLUI_StaticText *contactText;
 
   Location mouseDownLoc;
   int mouseDownDeltaX, mouseDownDeltaY;
   int mouseDownId;
   Color oldColor;
+
+  // The serial number of the environment, the selected object and the revision last
+  // shown by showStats
+  int statsEnv;
+  int statsId;
+  int statsRevision;
 };
@@ -0,0 +1,119 @@
+/**
+ * \author Lucas Kramer
+ * \file   SpatialGrid.cpp
+ * \brief  A uniform grid of circles for tracing rays through the environment
+ */
+
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+// Needed on some platforms to access the definition of pi, etc.  
+#define _USE_MATH_DEFINES
+#include <math.h>
+using namespace std;
+
+SpatialGrid::SpatialGrid(int width, int height, float cellSize) :
+  columns(0), rows(0),
+  cellSize(cellSize) {
+  if (cellSize <= 0)
+    throw new invalid_argument("SpatialGrid: Cell size must be positive.");
+  clear(width, height);
+}
+
+void SpatialGrid::clear(int width, int height) {
+  this->width = width;
+  this->height = height;
+  columns = max(1, (int)ceil(width / cellSize));
+  rows = max(1, (int)ceil(height / cellSize));
+  cells.resize(columns * rows);
+  for (vector<int> &cell : cells)
+    cell.clear();
+  circles.clear();
+}
+
+void SpatialGrid::insert(Location loc, float radius) {
+  int index = circles.size();
+  circles.push_back({loc.x, loc.y, radius});
+
+  int minColumn = max(0, (int)floor((loc.x - radius) / cellSize));
+  int maxColumn = min(columns - 1, (int)floor((loc.x + radius) / cellSize));
+  int minRow = max(0, (int)floor((loc.y - radius) / cellSize));
+  int maxRow = min(rows - 1, (int)floor((loc.y + radius) / cellSize));
+  for (int row = minRow; row <= maxRow; row++) {
+    for (int column = minColumn; column <= maxColumn; column++)
+      cells[row * columns + column].push_back(index);
+  }
+}
+
+float SpatialGrid::intersect(const Circle &circle, Location origin, float dx, float dy) {
+  float ox = origin.x - circle.x;
+  float oy = origin.y - circle.y;
+  float c = ox * ox + oy * oy - circle.radius * circle.radius;
+  if (c <= 0)
+    return 0; // The ray starts inside the circle
+
+  float b = ox * dx + oy * dy;
+  float discriminant = b * b - c;
+  if (b > 0 || discriminant < 0)
+    return -1;
+  return -b - sqrt(discriminant);
+}
+
+float SpatialGrid::castRay(Location origin, float orientation, float maxDistance) const {
+  float dx = sin(orientation * M_PI / 180);
+  float dy = cos(orientation * M_PI / 180);
+  const float infinity = numeric_limits<float>::infinity();
+
+  // The walls bound how far the ray can go
+  float limit = maxDistance;
+  if (dx > 0)
+    limit = min(limit, (width - origin.x) / dx);
+  else if (dx < 0)
+    limit = min(limit, -origin.x / dx);
+  if (dy > 0)
+    limit = min(limit, (height - origin.y) / dy);
+  else if (dy < 0)
+    limit = min(limit, -origin.y / dy);
+  if (limit < 0)
+    limit = 0;
+
+  // Grid DDA traversal, starting from the cell containing the origin
+  int column = min(columns - 1, max(0, (int)floor(origin.x / cellSize)));
+  int row = min(rows - 1, max(0, (int)floor(origin.y / cellSize)));
+  int stepColumn = dx > 0? 1 : -1;
+  int stepRow = dy > 0? 1 : -1;
+  float nextX = (column + (dx > 0? 1 : 0)) * cellSize;
+  float nextY = (row + (dy > 0? 1 : 0)) * cellSize;
+  float tMaxX = dx != 0? (nextX - origin.x) / dx : infinity;
+  float tMaxY = dy != 0? (nextY - origin.y) / dy : infinity;
+  float tDeltaX = dx != 0? cellSize / fabs(dx) : infinity;
+  float tDeltaY = dy != 0? cellSize / fabs(dy) : infinity;
+
+  float nearest = limit;
+  while (true) {
+    for (int index : cells[row * columns + column]) {
+      float t = intersect(circles[index], origin, dx, dy);
+      if (t >= 0 && t < nearest)
+        nearest = t;
+    }
+
+    // Any hit inside this cell is closer than anything in the cells after it
+    float exit = min(tMaxX, tMaxY);
+    if (nearest <= exit)
+      break;
+
+    if (tMaxX < tMaxY) {
+      column += stepColumn;
+      tMaxX += tDeltaX;
+    }
+    else {
+      row += stepRow;
+      tMaxY += tDeltaY;
+    }
+    if (column < 0 || column >= columns || row < 0 || row >= rows)
+      break;
+  }
+  return nearest;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file   SpatialGrid.h
+ * \brief  A uniform grid of circles for tracing rays through the environment
+ */
+
+#include "Location.h"
+#include "configuration.h"
+
+#include <vector>
+
+/**
+ * \brief A uniform grid over the environment, where each cell lists the circles that
+ * overlap it.  Rays are traced cell by cell, so the cost of a ray is proportional to
+ * the number of cells it crosses rather than the number of circles.  
+ */
+class SpatialGrid {
+public:
+  /**
+   * \brief SpatialGrid constructor
+   * \param width The width of the area covered
+   * \param height The height of the area covered
+   * \param cellSize The width and height of a cell in pixels
+   */
+  SpatialGrid(int width = GET_INT("DISPLAY_WIDTH"),
+              int height = GET_INT("DISPLAY_HEIGHT"),
+              float cellSize = GET_FLOAT("SPATIAL_GRID_CELL_SIZE"));
+
+  /**
+   * \brief Removes all circles and resizes the grid, keeping the allocated cells
+   * \param width The new width of the area covered
+   * \param height The new height of the area covered
+   */
+  void clear(int width, int height);
+
+  /**
+   * \brief Adds a circle to every cell that it overlaps
+   * \param loc The center of the circle
+   * \param radius The radius of the circle
+   */
+  void insert(Location loc, float radius);
+
+  /**
+   * Finds the distance along a ray to the first circle or wall that it hits
+   * \param origin The start of the ray
+   * \param orientation The direction of the ray in degrees, clockwise from +y like
+   * object orientations
+   * \param maxDistance The maximum distance to trace
+   * \return The distance to the first hit, or maxDistance if nothing is hit
+   */
+  float castRay(Location origin, float orientation, float maxDistance) const;
+
+private:
+  struct Circle {
+    float x, y, radius;
+  };
+
+  int width, height;
+  int columns, rows;
+  float cellSize;
+  std::vector<Circle> circles;
+  std::vector<std::vector<int> > cells;
+
+  /**
+   * Finds the distance along a ray to a circle
+   * \return The distance, or a negative value if the ray misses
+   */
+  static float intersect(const Circle &circle, Location origin, float dx, float dy);
+};
@@ -38,7 +38,7 @@ Target::~Target() {}
 
 bool Target::handleCollision(int, bool wasHit) {
   if (GET_BOOL("TARGET_RANDOM_WANDER")) {
-    setOrientation(rand() % 360);
+    setOrientation(random.nextInt(360));
   }
   else {
     reorient(GET_BOOL("OPPOSITE_ANGLES") && wasHit?
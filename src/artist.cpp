@@ -169,6 +169,22 @@ namespace artist {
     glPopMatrix();
   }
   
+  void drawRangeSensor(Location loc, int orientation, float distance, float intensity) {
+    glPushMatrix();
+    glTranslatef(loc.x, loc.y, 0.0f);
+    glRotatef(orientation, 0,0,-1); //Rotate about z-axis
+
+    int redvalue = intensity*256.0;
+    Color color = colorPicker(redvalue, 86,97);
+    glBegin(GL_LINES);
+    glColor3f(color.red, color.green, color.blue);
+    glVertex2f(0, 0);
+    glVertex2f(0, distance);
+    glEnd();
+    
+    glPopMatrix();
+  }
+  
   void drawRobot(Location loc, int radius, int orientation, Color color, Color lineColor) {
     glPushMatrix();
     glTranslatef(loc.x, loc.y, 0.0f);
@@ -63,6 +63,15 @@ namespace artist {
  * \param intensity redness of sensor as value between 0 and 1, meant to indicate amount of light detected
  */
   void drawSensor(Location loc, int orientation, int angle, float intensity);
+
+/**
+ * Draws a range sensor beam
+ * \param loc absolute Location of the start of the beam
+ * \param orientation absolute direction of the beam
+ * \param distance length of the beam up to the first hit
+ * \param intensity redness of the beam as value between 0 and 1, meant to indicate how close the hit is
+ */
+  void drawRangeSensor(Location loc, int orientation, float distance, float intensity);
   
 /**
  * Draws a Robot
@@ -9,27 +9,33 @@
 #include <stdlib.h>
 #include <time.h>
 #include <sys/prctl.h>
+#include <iostream>
 
 #include "OptimizeSimulation.h"
 #include "Simulation.h"
+#include "Environment.h"
 #include "configuration.h"
 
 #define DEFAULT_CONFIG "../config/default" // Can't use INSTALL_DIR since it needs config to be loaded first...
 
 /** Main function to execute the simulation */
 int main(int argc, char* argv[]) {
-  // Seed RNG
-  srand(time(NULL));
-  
   // Change process name so hopefully people don't kill this...
   prctl(PR_SET_NAME, (long int)"plzDontKillMe");
 
   // Initialize the configuration library
   Configuration::initConfig(argc, argv, DEFAULT_CONFIG);
+
+  // Seed the RNG of the environment used by the simulation
+  Environment::getEnv()->seedRandom(time(NULL));
   
   // Run the simulation
-  if (GET_BOOL("OPTIMIZE_SIMULATION")) {
-    OptimizeSimulation *app = new OptimizeSimulation(argc, argv);
+  if (GET_BOOL("EVALUATE_NETWORK")) {
+    NeuralNetwork network = NeuralNetwork::get(GET_STRING("OPTIMAL_NEURAL_NETWORK_FILE"));
+    std::cout << OptimizeSimulation::getPerformance(network) << std::endl;
+  }
+  else if (GET_BOOL("OPTIMIZE_SIMULATION")) {
+    OptimizeSimulation *app = new OptimizeSimulation(argc, argv, DEFAULT_CONFIG);
     app->runMainLoop();
   }
   else {
@@ -62,7 +62,8 @@
  * 
  * To run the optimization, run ./optimize from the scripts folder.  The temporary and
  * intermediate files get saved to runtime/neuralnetwork.  This includes the optimization
- * log, pool performances, optimial network, pool networks, and several others.  
+ * log, the optimial network, and the pool file, which holds the pool networks and their
+ * performances and is shared by every optimization process running at once.  
  *
  * \section Implementation
  * The various objects are all subclasses of PhysicalObject, which handles basic behaviors
@@ -0,0 +1,120 @@
+/**
+ * \author Lucas Kramer
+ * \file   networkkernel.cpp
+ * \brief  Evaluators specialized at compile time for known network topologies, and
+ * vectorizable activation functions
+ */
+
+#include "networkkernel.h"
+
+namespace networkkernel {
+  namespace {
+    /**
+     * The lattice topology used by the optimizer, in runtime/neuralnetwork/optimized.
+     * Each layer has one fewer node than the last, with each node connected to two
+     * neighbours in the layer before, down to 3 nodes that are all connected to both
+     * outputs.  
+     */
+    struct Lattice {
+      static constexpr unsigned numInputs = 6, numNodes = 20, numOutputs = 2;
+      static constexpr unsigned numConnections = 30;
+      static constexpr unsigned start[numNodes - numInputs + 1] = {
+        0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 27, 30
+      };
+      static constexpr int source[numConnections] = {
+        0, 1,  1, 2,  2, 3,  3, 4,  4, 5,
+        6, 7,  7, 8,  8, 9,  9, 10,
+        11, 12,  12, 13,  13, 14,
+        15, 16, 17,  15, 16, 17
+      };
+      static constexpr int outputs[numOutputs] = {18, 19};
+    };
+    constexpr unsigned Lattice::start[];
+    constexpr int Lattice::source[];
+    constexpr int Lattice::outputs[];
+
+    // Adds the connections from First to Last of a node, in order
+    template <class T, unsigned First, unsigned Last>
+    struct Connections {
+      static inline float sum(float value, const float *values, const float *weights) {
+        return Connections<T, First + 1, Last>::
+          sum(value + values[T::source[First]] * weights[First], values, weights);
+      }
+    };
+
+    template <class T, unsigned Last>
+    struct Connections<T, Last, Last> {
+      static inline float sum(float value, const float *, const float *) {
+        return value;
+      }
+    };
+
+    // Computes the nodes from Node on, in order
+    template <class T, unsigned Node, bool Done = Node == T::numNodes>
+    struct Nodes {
+      static inline void compute(float *values, const float *params) {
+        const unsigned i = Node - T::numInputs;
+        values[Node] = Connections<T, T::start[i], T::start[i + 1]>::
+          sum(params[i], values, params + T::numNodes - T::numInputs);
+        Nodes<T, Node + 1>::compute(values, params);
+      }
+    };
+
+    template <class T, unsigned Node>
+    struct Nodes<T, Node, true> {
+      static inline void compute(float *, const float *) {}
+    };
+
+    template <class T>
+    void evaluate(const float *params, const float *inputs, float *outputs) {
+      float values[T::numNodes];
+      for (unsigned i = 0; i < T::numInputs; i++)
+        values[i] = inputs[i];
+      Nodes<T, T::numInputs>::compute(values, params);
+      for (unsigned i = 0; i < T::numOutputs; i++)
+        outputs[i] = values[T::outputs[i]];
+    }
+
+    template <class T>
+    Topology describe(const char *name) {
+      Topology topology = {
+        name, T::numInputs, T::numNodes, T::numOutputs, T::numConnections,
+        T::start, T::source, T::outputs, evaluate<T>
+      };
+      return topology;
+    }
+  }
+
+  const char *getActivationName(Activation activation) {
+    switch (activation) {
+    case TANH:
+      return "tanh";
+    case SIGMOID:
+      return "sigmoid";
+    default:
+      return "linear";
+    }
+  }
+
+  void activate(Activation activation, float *values, unsigned count) {
+    switch (activation) {
+    case TANH:
+      for (unsigned i = 0; i < count; i++)
+        values[i] = tanhApprox(values[i]);
+      break;
+    case SIGMOID:
+      for (unsigned i = 0; i < count; i++)
+        values[i] = sigmoidApprox(values[i]);
+      break;
+    default:
+      break;
+    }
+  }
+
+  const std::vector<Topology> &getTopologies() {
+    static const std::vector<Topology> topologies = {
+      describe<Lattice>("lattice")
+    };
+    return topologies;
+  }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file   networkkernel.h
+ * \brief  Evaluators specialized at compile time for known network topologies, and
+ * vectorizable activation functions
+ */
+
+#include <vector>
+
+/**
+ * \brief networkkernel namespace, evaluates networks whose structure is known at compile
+ * time
+ * \details A topology lists, for every node after the inputs, the nodes it is connected
+ * to.  Its evaluator is generated from that description with every loop unrolled, and
+ * reads the baselines and weights of a particular network from a parameter array.  
+ * Networks are matched to a topology when they are compiled, and evaluate exactly as
+ * the generic path does.  
+ */
+namespace networkkernel {
+  /** \brief The function applied to a node's weighted sum to get its value */
+  enum Activation {LINEAR, TANH, SIGMOID, NUM_ACTIVATIONS};
+
+  /**
+   * \brief Gets the name of an activation, as used in network files
+   * \param activation the activation
+   * \return the name
+   */
+  const char *getActivationName(Activation activation);
+
+  /**
+   * \brief Approximates tanh with the [7/6] Pade approximant, which is within 1e-4 of it
+   * everywhere.  There are no branches or table lookups, so loops over it vectorize.  
+   * \param x the value
+   * \return tanh(x)
+   */
+  inline float tanhApprox(float x) {
+    // The approximant is closest to tanh up to here, and grows past 1 further out
+    const float limit = 4.97f;
+    x = x < -limit? -limit : x;
+    x = x > limit? limit : x;
+    float x2 = x * x;
+    float p = x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2)));
+    float q = 135135.0f + x2 * (62370.0f + x2 * (3150.0f + x2 * 28.0f));
+    return p / q;
+  }
+
+  /**
+   * \brief Approximates the logistic sigmoid 1 / (1 + exp(-x)) through tanhApprox
+   * \param x the value
+   * \return the sigmoid of x
+   */
+  inline float sigmoidApprox(float x) {
+    return 0.5f + 0.5f * tanhApprox(0.5f * x);
+  }
+
+  /**
+   * \brief Applies an activation to an array of values in place.  This is vectorized, and
+   * budgeted to keep batches of networks with an activation on every node within 2.5
+   * times the time of linear ones, as nnconvert --benchmark reports.  
+   * \param activation the activation
+   * \param values the values
+   * \param count the number of values
+   */
+  void activate(Activation activation, float *values, unsigned count);
+
+  /**
+   * \brief An evaluator for a topology
+   * \param params the baseline of every node after the inputs, then the weight of every
+   * connection, in node order
+   * \param inputs the input values
+   * \param outputs space for the output values
+   */
+  typedef void (*Evaluator)(const float *params, const float *inputs, float *outputs);
+
+  /** \brief A topology with a specialized evaluator */
+  struct Topology {
+    const char *name;
+    unsigned numInputs, numNodes, numOutputs, numConnections;
+    const unsigned *start; // The first connection of each node after the inputs, and the end
+    const int *source;     // The node each connection comes from
+    const int *outputs;    // The node for each output
+    Evaluator evaluate;
+  };
+
+  /**
+   * \brief Gets every topology with a specialized evaluator
+   * \return the topologies
+   */
+  const std::vector<Topology> &getTopologies();
+}
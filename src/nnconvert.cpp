@@ -0,0 +1,133 @@
+/**
+ * \file  nnconvert.cpp
+ * \brief A tool to convert neural network files between the text and binary formats,
+ * set their activation functions, and to time loading and computing them
+ * \author Lucas Kramer
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "NeuralNetwork.h"
+
+/** Prints the usage of the tool and exits */
+static void usage(const char *name) {
+  cerr << "Usage: " << name << " --binary <input> <output>" << endl;
+  cerr << "       " << name << " --text <input> <output>" << endl;
+  cerr << "       " << name << " --activation <linear|tanh|sigmoid> <input> <output>" << endl;
+  cerr << "       " << name << " --benchmark <input> [iterations]" << endl;
+  exit(1);
+}
+
+/** Main function to convert a network or time loading it */
+int main(int argc, char* argv[]) {
+  if (argc < 3)
+    usage(argv[0]);
+  string mode = argv[1];
+  string input = argv[2];
+
+  if (mode == "--binary" || mode == "--text") {
+    if (argc != 4)
+      usage(argv[0]);
+    NeuralNetwork network = NeuralNetwork::load(input);
+    if (mode == "--binary")
+      network.writeBinary(argv[3]);
+    else
+      network.write(argv[3]);
+  }
+  else if (mode == "--activation") {
+    if (argc != 5)
+      usage(argv[0]);
+    int activation = 0;
+    while (activation < networkkernel::NUM_ACTIVATIONS &&
+           input != networkkernel::getActivationName((networkkernel::Activation)activation))
+      activation++;
+    if (activation == networkkernel::NUM_ACTIVATIONS)
+      usage(argv[0]);
+    NeuralNetwork::load(argv[3]).withActivation((networkkernel::Activation)activation).write(argv[4]);
+  }
+  else if (mode == "--benchmark") {
+    int iterations = argc > 3? atoi(argv[3]) : 1000;
+    if (iterations <= 0)
+      usage(argv[0]);
+
+    // Time loading the file as given, then in each format through temporary copies
+    NeuralNetwork network = NeuralNetwork::load(input);
+    string textFile = input + ".benchmark.txt";
+    string binaryFile = input + ".benchmark.bin";
+    network.write(textFile);
+    network.writeBinary(binaryFile);
+
+    vector<float> inputs(network.getNumInputs(), 0.5);
+    for (const string &file : {textFile, binaryFile}) {
+      auto start = chrono::steady_clock::now();
+      float check = 0;
+      for (int i = 0; i < iterations; i++)
+        check += NeuralNetwork::load(file).compute(inputs)[0];
+      double elapsed = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+      cout << (file == textFile? "text   " : "binary ") <<
+        elapsed / iterations << " us per load (" << iterations << " loads, check " <<
+        check / iterations << ")" << endl;
+    }
+    remove(textFile.c_str());
+    remove(binaryFile.c_str());
+
+    // Time computing the network, with the evaluator selected for it and with the
+    // generic evaluator, which batches of a single set of inputs always use
+    vector<float> scratch(network.getScratchSize()), outputs(network.getNumOutputs());
+    int computeIterations = iterations * 1000;
+    for (int generic = 0; generic < 2; generic++) {
+      fill(inputs.begin(), inputs.end(), 0.5);
+      auto start = chrono::steady_clock::now();
+      float check = 0;
+      for (int i = 0; i < computeIterations; i++) {
+        inputs[i % inputs.size()] = (i % 100) / 100.0;
+        if (generic)
+          network.compute(inputs.data(), outputs.data(), 1, scratch.data());
+        else
+          network.compute(inputs.data(), outputs.data(), scratch.data());
+        check += outputs[0];
+      }
+      double elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+      cout << "compute " << (generic? "generic" : network.getEvaluatorName()) << " " <<
+        elapsed / computeIterations << " ns per call (check " << check / computeIterations << ")" << endl;
+    }
+
+    // Time computing batches with each activation on every node.  The approximations
+    // should keep them within 2.5 times the time of the linear case.  
+    const unsigned batchSize = 64;
+    int batchIterations = max(computeIterations / (int)batchSize, 1);
+    double linearTime = 0;
+    for (int a = 0; a < networkkernel::NUM_ACTIVATIONS; a++) {
+      NeuralNetwork variant = network.withActivation((networkkernel::Activation)a);
+      vector<float> batchInputs(batchSize * variant.getNumInputs());
+      vector<float> batchOutputs(batchSize * variant.getNumOutputs());
+      vector<float> batchScratch(batchSize * variant.getScratchSize());
+      for (unsigned i = 0; i < batchInputs.size(); i++)
+        batchInputs[i] = (i % 100) / 100.0;
+      auto start = chrono::steady_clock::now();
+      float check = 0;
+      for (int i = 0; i < batchIterations; i++) {
+        batchInputs[i % batchInputs.size()] = (i % 100) / 100.0;
+        variant.compute(batchInputs.data(), batchOutputs.data(), batchSize, batchScratch.data());
+        check += batchOutputs[0];
+      }
+      double elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() /
+        (batchIterations * batchSize);
+      if (a == networkkernel::LINEAR)
+        linearTime = elapsed;
+      cout << "batch " << networkkernel::getActivationName((networkkernel::Activation)a) << " " <<
+        elapsed << " ns per network (" << elapsed / linearTime << " times linear, check " <<
+        check / batchIterations << ")" << endl;
+    }
+  }
+  else
+    usage(argv[0]);
+
+  return 0;
+}
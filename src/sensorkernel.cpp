@@ -0,0 +1,80 @@
+/**
+ * \author Lucas Kramer
+ * \file   sensorkernel.cpp
+ * \brief  Vectorized evaluation of the sensor falloff over packed object positions
+ */
+
+#include "sensorkernel.h"
+
+// Needed on some platforms to access the definition of pi, etc.  
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+namespace sensorkernel {
+  // Defined in sensorkernel_avx2.cpp, which is the only file built with AVX2 enabled
+  bool avx2Compiled();
+
+  typedef float (*Kernel)(const float*, const float*, unsigned, Location, int, int);
+
+  namespace {
+    Kernel getKernel() {
+      static const Kernel kernel = hasAVX2()? senseAVX2 : senseScalar;
+      return kernel;
+    }
+  }
+
+  float sense(const float *x, const float *y, unsigned count,
+              Location loc, int orientation, int viewAngle) {
+    return getKernel()(x, y, count, loc, orientation, viewAngle);
+  }
+
+  const float *getFalloffTable() {
+    static const struct FalloffTable {
+      float values[FALLOFF_TABLE_SIZE];
+      FalloffTable() {
+        for (int i = 0; i < FALLOFF_TABLE_SIZE; i++)
+          values[i] = 1.0 / exp(3 * (double)i);
+      }
+    } table;
+    return table.values;
+  }
+
+  float senseScalar(const float *x, const float *y, unsigned count,
+                    Location loc, int orientation, int viewAngle) {
+    float distanceSquared, delta_x, delta_y;
+    int absoluteAngleToLight, angle;
+
+    float strength = 0.0;
+    for (unsigned i = 0; i < count; i++) {
+      // The angle between two objects
+      // Angle = atan2 (delta x, delta y)
+      delta_x = x[i] - loc.x;
+      delta_y = y[i] - loc.y;
+      absoluteAngleToLight = (int)(atan2(delta_x, delta_y) * 180 / M_PI);
+      angle = (absoluteAngleToLight + 720 - orientation) % 360;
+      if (angle > 180)
+        angle -= 360;
+
+      // Note that the division is done on integers, so the falloff is a step function
+      float angleBrightnessScale = getFalloff(2 * angle / viewAngle);
+
+      distanceSquared  = pow(delta_x, 2.0);
+      distanceSquared += pow(delta_y, 2.0);
+      strength += angleBrightnessScale / distanceSquared;
+    }
+    return strength;
+  }
+
+  bool hasAVX2() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return avx2Compiled() && __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+  }
+
+  const char *getKernelName() {
+    return getKernel() == senseAVX2? "avx2" : "scalar";
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file   sensorkernel.h
+ * \brief  Vectorized evaluation of the sensor falloff over packed object positions
+ */
+
+#include "Location.h"
+
+/**
+ * \brief sensorkernel namespace, computes the raw (unscaled, unclamped) strength seen
+ * by a sensor from a flat list of points
+ * \details For every point the bearing relative to the sensor orientation selects an
+ * angular falloff, which is divided by the squared distance and summed.  This is the
+ * same computation as the original loop in Sensor::sense.  An AVX2 version is selected
+ * at runtime when the processor supports it, otherwise the scalar version is used.  
+ */
+namespace sensorkernel {
+  /**
+   * \brief Computes the strength with the fastest kernel supported by this machine
+   * \param x The x positions of the points
+   * \param y The y positions of the points
+   * \param count The number of points
+   * \param loc The absolute location of the sensor
+   * \param orientation The absolute orientation of the sensor in degrees
+   * \param viewAngle The view angle of the sensor in degrees
+   * \return The summed strength
+   */
+  float sense(const float *x, const float *y, unsigned count,
+              Location loc, int orientation, int viewAngle);
+
+  /**
+   * \brief The portable scalar kernel, which every other kernel must match
+   * \see sense
+   */
+  float senseScalar(const float *x, const float *y, unsigned count,
+                    Location loc, int orientation, int viewAngle);
+
+  /**
+   * \brief The AVX2 kernel.  Only valid to call when hasAVX2() is true
+   * \see sense
+   */
+  float senseAVX2(const float *x, const float *y, unsigned count,
+                  Location loc, int orientation, int viewAngle);
+
+  /**
+   * \brief The number of entries in the falloff table.  Larger levels have no
+   * falloff table entry because the falloff underflows to 0.  
+   */
+  const int FALLOFF_TABLE_SIZE = 64;
+
+  /**
+   * \brief Gets the table of angular falloffs, indexed by the square of the angle level
+   * \return FALLOFF_TABLE_SIZE values of 1 / exp(3 * i)
+   */
+  const float *getFalloffTable();
+
+  /**
+   * \brief Gets the angular falloff for the level of the angle to an object
+   * \param level 2 * angle / viewAngle, using integer division
+   * \return 1 / exp(3 * level^2)
+   */
+  inline float getFalloff(int level) {
+    int index = level * level;
+    return index < FALLOFF_TABLE_SIZE? getFalloffTable()[index] : 0;
+  }
+
+  /**
+   * \brief Checks if the AVX2 kernel was compiled in and is supported by the processor
+   * \return true when senseAVX2 may be called
+   */
+  bool hasAVX2();
+
+  /**
+   * \brief Gets the name of the kernel selected by sense
+   * \return "avx2" or "scalar"
+   */
+  const char *getKernelName();
+}
@@ -0,0 +1,140 @@
+/**
+ * \author Lucas Kramer
+ * \file   sensorkernel_avx2.cpp
+ * \brief  AVX2 version of the sensor kernel.  This is the only file compiled with
+ * -mavx2, and it is only called after checking that the processor supports it.  
+ */
+
+#include "sensorkernel.h"
+
+// Needed on some platforms to access the definition of pi, etc.  
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+namespace {
+  /**
+   * atan2(y, x) in radians for 8 lanes, accurate to about 1e-7.  
+   * Reduces to atan on [0, tan(pi/8)] and uses the cephes polynomial.  
+   */
+  inline __m256 atan2_ps(__m256 y, __m256 x) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 ay = _mm256_andnot_ps(signMask, y);
+    __m256 ax = _mm256_andnot_ps(signMask, x);
+    __m256 hi = _mm256_max_ps(ax, ay);
+    __m256 lo = _mm256_min_ps(ax, ay);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    // t in [0, 1], guarding 0/0 at the origin
+    __m256 t = _mm256_div_ps(lo, _mm256_blendv_ps(hi, one, _mm256_cmp_ps(hi, zero, _CMP_EQ_OQ)));
+
+    __m256 reduce = _mm256_cmp_ps(t, _mm256_set1_ps(0.41421356f), _CMP_GT_OQ);
+    __m256 offset = _mm256_and_ps(reduce, _mm256_set1_ps((float)M_PI_4));
+    t = _mm256_blendv_ps(t, _mm256_div_ps(_mm256_sub_ps(t, one), _mm256_add_ps(t, one)),
+                         reduce);
+
+    __m256 z = _mm256_mul_ps(t, t);
+    __m256 p = _mm256_set1_ps(8.05374449538e-2f);
+    p = _mm256_sub_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(1.38776856032e-1f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(1.99777106478e-1f));
+    p = _mm256_sub_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(3.33329491539e-1f));
+    p = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(p, z), t), t);
+    __m256 r = _mm256_add_ps(p, offset);
+
+    // Undo the octant, quadrant and sign reductions
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps((float)M_PI_2), r),
+                         _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps((float)M_PI), r),
+                         _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+    return _mm256_or_ps(r, _mm256_and_ps(y, signMask));
+  }
+}
+
+namespace sensorkernel {
+  bool avx2Compiled() {
+    return true;
+  }
+
+  float senseAVX2(const float *x, const float *y, unsigned count,
+                  Location loc, int orientation, int viewAngle) {
+    if (viewAngle <= 0)
+      return senseScalar(x, y, count, loc, orientation, viewAngle);
+
+    const __m256 locX = _mm256_set1_ps(loc.x);
+    const __m256 locY = _mm256_set1_ps(loc.y);
+    const __m256 toDegrees = _mm256_set1_ps((float)(180 / M_PI));
+    const __m256 view = _mm256_set1_ps((float)viewAngle);
+    const __m256i offset = _mm256_set1_epi32(720 - orientation);
+    const __m256i i180 = _mm256_set1_epi32(180);
+    const __m256i i359 = _mm256_set1_epi32(359);
+    const __m256i i360 = _mm256_set1_epi32(360);
+    const __m256i maxLevel = _mm256_set1_epi32(FALLOFF_TABLE_SIZE - 1);
+    const __m256 nearInteger = _mm256_set1_ps(1e-3f);
+    const float *falloff = getFalloffTable();
+
+    __m256 sum = _mm256_setzero_ps();
+    unsigned i = 0;
+    for (; i + 8 <= count; i += 8) {
+      __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), locX);
+      __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), locY);
+
+      __m256 degrees = _mm256_mul_ps(atan2_ps(dx, dy), toDegrees);
+      __m256i absoluteAngle = _mm256_cvttps_epi32(degrees);
+
+      // The truncation is only ambiguous right next to a whole degree, so redo those
+      // lanes exactly as the scalar kernel does
+      __m256 fraction = _mm256_sub_ps(degrees, _mm256_round_ps(degrees, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+      int ambiguous = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), fraction),
+                                                       nearInteger, _CMP_LT_OQ));
+      if (ambiguous) {
+        alignas(32) int angles[8];
+        _mm256_store_si256((__m256i*)angles, absoluteAngle);
+        for (int lane = 0; lane < 8; lane++) {
+          if (ambiguous & (1 << lane))
+            angles[lane] = (int)(atan2(x[i + lane] - loc.x, y[i + lane] - loc.y) * 180 / M_PI);
+        }
+        absoluteAngle = _mm256_load_si256((__m256i*)angles);
+      }
+
+      // angle = (absoluteAngle + 720 - orientation) % 360, where the sum is in [180, 1260]
+      __m256i angle = _mm256_add_epi32(absoluteAngle, offset);
+      angle = _mm256_sub_epi32(angle, _mm256_and_si256(_mm256_cmpgt_epi32(angle, i359), i360));
+      angle = _mm256_sub_epi32(angle, _mm256_and_si256(_mm256_cmpgt_epi32(angle, i359), i360));
+      angle = _mm256_sub_epi32(angle, _mm256_and_si256(_mm256_cmpgt_epi32(angle, i359), i360));
+      angle = _mm256_sub_epi32(angle, _mm256_and_si256(_mm256_cmpgt_epi32(angle, i180), i360));
+
+      // Integer division 2 * angle / viewAngle, exact since both fit easily in a float
+      __m256i level = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(angle, angle)), view));
+      level = _mm256_min_epi32(_mm256_mullo_epi32(level, level), maxLevel);
+      __m256 scale = _mm256_i32gather_ps(falloff, level, 4);
+
+      __m256 distanceSquared = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+      sum = _mm256_add_ps(sum, _mm256_div_ps(scale, distanceSquared));
+    }
+
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, sum);
+    float strength = 0.0;
+    for (int lane = 0; lane < 8; lane++)
+      strength += lanes[lane];
+    return strength + senseScalar(x + i, y + i, count - i, loc, orientation, viewAngle);
+  }
+}
+
+#else
+
+namespace sensorkernel {
+  bool avx2Compiled() {
+    return false;
+  }
+
+  float senseAVX2(const float *x, const float *y, unsigned count,
+                  Location loc, int orientation, int viewAngle) {
+    return senseScalar(x, y, count, loc, orientation, viewAngle);
+  }
+}
+
+#endif
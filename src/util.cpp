@@ -7,7 +7,6 @@
 #include <unistd.h>
 #include <stack>
 #include <queue>
-#include <mutex>
 #include <stdexcept>
 #include <sstream>
 #include <iostream>
@@ -32,16 +31,14 @@ using namespace std;
 #include "util.h"
 using namespace util;
 
-// Object addition/removal
-static mutex objectsMutex;
-
-static stack<int> robots;
-static stack<int> targets;
-static stack<int> lights;
-static stack<int> obstacles;
+// Objects added through util, kept for each thread since each has its own environment
+static thread_local stack<int> robots;
+static thread_local stack<int> targets;
+static thread_local stack<int> lights;
+static thread_local stack<int> obstacles;
 
 // Colors
-static int colorNum = 0;
+static thread_local int colorNum = 0;
 
 PhysicalObject* util::getObject(int id) {
   return Environment::getEnv()->getObject(id);
@@ -68,8 +65,6 @@ void util::display() {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   // drawing commands go here
-  objectsMutex.lock();
-
   // Draw background first
   artist::drawBackground();
   for (PhysicalObject *o : *Environment::getEnv()) {
@@ -87,7 +82,6 @@ void util::display() {
     if (o->isHitable)
       o->display();
   }
-  objectsMutex.unlock();
 
   // debugging messages
   int err;
@@ -101,12 +95,11 @@ void util::display() {
 }
 
 void util::advance() {
-  objectsMutex.lock();
+  Environment::getEnv()->step();
   for (PhysicalObject *o : *Environment::getEnv()) {
     if (o->updatePosition())
       break;
   }
-  objectsMutex.unlock();
 }
 
 Color util::newColor() {
@@ -161,7 +154,6 @@ bool util::addRobotTarget(int robotType,
   Robot *r = NULL;
   Target *t = NULL;
   try {
-    objectsMutex.lock();
     t = new Target(GET_INT("TARGET_RADIUS"),
                    targetColor,
                    LAST + targets.size() + 1);
@@ -195,20 +187,18 @@ bool util::addRobotTarget(int robotType,
       r = new NeuralNetworkRobot(GET_INT("ROBOT_RADIUS"),
                                  GET_COLOR("ROBOT_COLOR"),
                                  targetColor,
-                                 NeuralNetwork::load(neuralNetworkFile),
+                                 NeuralNetwork::get(neuralNetworkFile),
                                  t->getId());
       break;
     default:
       throw new invalid_argument("Invalid robot type");
     }
-    objectsMutex.unlock();
     robots.push(r->getId());
     targets.push(t->getId());
   }
   catch (const NoOpenLocationException *e) {
     if (t != NULL)
       delete t;
-    objectsMutex.unlock();
     return false;
   }
   
@@ -236,7 +226,6 @@ bool util::addRobot(int robotType,
   Color color = newColor();
   Robot *r = NULL;
   try {
-    objectsMutex.lock();
     switch (robotType) {
     case 0:
       r = new SimpleRobot(GET_INT("ROBOT_RADIUS"),
@@ -267,19 +256,17 @@ bool util::addRobot(int robotType,
       r = new NeuralNetworkRobot(GET_INT("ROBOT_RADIUS"),
                                  GET_COLOR("ROBOT_COLOR"),
                                  color,
-                                 NeuralNetwork::load(neuralNetworkFile),
+                                 NeuralNetwork::get(neuralNetworkFile),
                                  -1,
                                  neuralNetworkFile);
       break;
     default:
       throw new invalid_argument("Invalid robot type");
     }
-    objectsMutex.unlock();
     robots.push(r->getId());
     targets.push(-1);
   }
   catch (const NoOpenLocationException *e) {
-    objectsMutex.unlock();
     return false;
   }
 
@@ -301,7 +288,6 @@ bool util::addNeuralNetworkRobotTarget(const NeuralNetwork &network) {
   Robot *r = NULL;
   Target *t = NULL;
   try {
-    objectsMutex.lock();
     t = new Target(GET_INT("TARGET_RADIUS"),
                    targetColor,
                    LAST + targets.size() + 1);
@@ -310,14 +296,12 @@ bool util::addNeuralNetworkRobotTarget(const NeuralNetwork &network) {
                                targetColor,
                                network,
                                t->getId());
-    objectsMutex.unlock();
     robots.push(r->getId());
     targets.push(t->getId());
   }
   catch (const NoOpenLocationException *e) {
     if (t != NULL)
       delete t;
-    objectsMutex.unlock();
     return false;
   }
   
@@ -334,14 +318,11 @@ bool util::addNeuralNetworkRobotTarget(const NeuralNetwork &network) {
 bool util::addStationaryLightSource() {
   LightSource *l;
   try {
-    objectsMutex.lock();
     l = new LightSource(GET_INT("LIGHT_SOURCE_RADIUS"),
                         GET_COLOR("LIGHT_SOURCE_COLOR"));
-    objectsMutex.unlock();
     lights.push(l->getId());
   }
   catch (const NoOpenLocationException *e) {
-    objectsMutex.unlock();
     return false;
   }
 
@@ -357,14 +338,11 @@ bool util::addStationaryLightSource() {
 bool util::addMovingLightSource() {
   LightSource *l;
   try {
-    objectsMutex.lock();
     l = new LightSource(GET_INT("LIGHT_SOURCE_RADIUS"),
                         GET_COLOR("LIGHT_SOURCE_COLOR"));
-    objectsMutex.unlock();
     lights.push(l->getId());
   }
   catch (const NoOpenLocationException *e) {
-    objectsMutex.unlock();
     return false;
   }
 
@@ -380,15 +358,12 @@ bool util::addMovingLightSource() {
 bool util::addObstacle() {
   Obstacle *o;
   try {
-    objectsMutex.lock();
     o = new Obstacle(GET_INT("MAX_OBSTACLE_RADIUS"),
           GET_INT("MIN_OBSTACLE_RADIUS"), 
           GET_COLOR("OBSTACLE_COLOR"));
-    objectsMutex.unlock();
     obstacles.push(o->getId());
   }
   catch (const NoOpenLocationException *e) {
-    objectsMutex.unlock();
     return false;
   }
 
@@ -404,9 +379,7 @@ bool util::copy(int id, Location loc) {
   if (id != -1 && getObject(id) != NULL) {
     PhysicalObject *obj = getObject(id);
     try {
-      objectsMutex.lock();
       if (Environment::getEnv()->isCollidingWithHitable(loc, obj->getRadius())) {
-        objectsMutex.unlock();
         return false;
       }
       
@@ -448,11 +421,10 @@ bool util::copy(int id, Location loc) {
           nnrIn = (NeuralNetworkRobot*)rIn;
           r = new NeuralNetworkRobot(obj->getRadius(), loc,
                                      obj->getColor(), rIn->getLineColor(),
-                                     NeuralNetwork::load(nnrIn->filename),
+                                     NeuralNetwork::get(nnrIn->filename),
                                      rIn->getTarget());
           break;
         default:
-          objectsMutex.unlock();
           return false;
         }
         r->setOrientation(obj->getOrientation());
@@ -485,13 +457,10 @@ bool util::copy(int id, Location loc) {
         }
         break;
       default:
-        objectsMutex.unlock();
         return false;
       }
-      objectsMutex.unlock();
     }
     catch (const NoOpenLocationException *e) {
-      objectsMutex.unlock();
       return false;
     }
   }
@@ -502,7 +471,6 @@ bool util::copy(int id, Location loc) {
 bool util::removeRobotTarget() {
   bool success = false;
   while (!robots.empty() && !success) {
-    objectsMutex.lock();
     if (getObject(robots.top()) != NULL) {
       if (GET_BOOL("DEBUG_MESSAGES")) {
         cout << "Removed robot " << robots.top() << endl;
@@ -514,7 +482,6 @@ bool util::removeRobotTarget() {
     delete getObject(robots.top()); // Destructor calls removeObject
     if (targets.top() != -1)
       delete getObject(targets.top());
-    objectsMutex.unlock();
     robots.pop();
     targets.pop();
   }
@@ -525,7 +492,6 @@ bool util::removeRobotTarget() {
 bool util::removeLightSource() {
   bool success = false;
   while (!lights.empty() && !success) {
-    objectsMutex.lock();
     if (getObject(lights.top()) != NULL) {
       if (GET_BOOL("DEBUG_MESSAGES")) {
         cout << "Removed light source " << lights.top() << endl;
@@ -533,7 +499,6 @@ bool util::removeLightSource() {
       success = true;
     }
     delete getObject(lights.top()); // Destructor calls removeObject
-    objectsMutex.unlock();
     lights.pop();
   }
 
@@ -544,14 +509,12 @@ bool util::removeObstacle() {
   bool success = false;
   while (!obstacles.empty() && !success) {
     if (getObject(obstacles.top()) != NULL) {
-      objectsMutex.lock();
       if (GET_BOOL("DEBUG_MESSAGES")) {
         cout << "Removed obstacle " << obstacles.top() << endl;
       }
       success = true;
     }
     delete getObject(obstacles.top()); // Destructor calls removeObject
-    objectsMutex.unlock();
     obstacles.pop();
   }
 
@@ -566,11 +529,9 @@ void util::removeAllRobotTarget() {
       if (targets.top() != -1)
         cout << "Removed target " << targets.top() << endl;
     }
-    objectsMutex.lock();
     delete getObject(robots.top()); // Destructor calls removeObject
     if (targets.top() != -1)
       delete getObject(targets.top());
-    objectsMutex.unlock();
     robots.pop();
     targets.pop();
   }
@@ -582,10 +543,8 @@ void util::removeAllLightSource() {
         getObject(lights.top()) != NULL) {
       cout << "Removed light source " << lights.top() << endl;
     }
-    objectsMutex.lock();
     //removeObject(lights.top());
     delete getObject(lights.top()); // Destructor calls removeObject
-    objectsMutex.unlock();
     lights.pop();
   }
 }
@@ -596,10 +555,8 @@ void util::removeAllObstacle() {
         getObject(obstacles.top()) != NULL) {
       cout << "Removed obstacle " << obstacles.top() << endl;
     }
-    objectsMutex.lock();
     //removeObject(obstacles.top());
     delete getObject(obstacles.top()); // Destructor calls removeObject
-    objectsMutex.unlock();
     obstacles.pop();
   }
 }
@@ -738,7 +695,7 @@ bool util::open(string filename) {
         tokens.pop();
         r = new NeuralNetworkRobot(radius, Location(xPos, yPos),
                                    Color(red, green, blue), Color(lineRed, lineGreen, lineBlue),
-                                   NeuralNetwork::load(networkFilename),
+                                   NeuralNetwork::get(networkFilename),
                                    targetId);
         break;
       default: